@@ -0,0 +1,228 @@
+/*
+ * Copyright 2018-2019 Kacper Kasper <kacperkasper@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+#ifndef BRACEINDEX_H
+#define BRACEINDEX_H
+
+#include <algorithm>
+#include <vector>
+
+#include "GapVector.h"
+#include "common.h"
+
+// Positions of the bracket operators found by Lex, paired up as they are
+// found, so that hosts can match braces without scanning styles.
+//
+// Like SCI_BRACEMATCH, each of {}, [] and () is paired on its own, so each
+// type has its own list. Every bracket remembers the innermost opening
+// bracket of its type enclosing it, which is all that is needed to rebuild
+// the pairing state when Lex starts again in the middle of the document.
+//
+// The brackets after the text Lex gets to stay, moved by the length the
+// document gained since the previous call, for the token stream to reuse.
+// That is only where they are if nothing was edited after that text, which
+// the lexer cannot tell, so they are not answered for until a later Lex
+// gets to them or finds their text unchanged. They sit after the gap of a
+// GapVector and are linked by distances, so only the brackets which are
+// not inside another one after the lexed text are paired again.
+class BraceIndex {
+	enum { types = 3 };
+	struct Brace {
+		Sci_Position position;
+		int match;			// distance to the paired bracket, 0 if none (yet)
+		int enclosing;		// to the innermost open bracket around it, 0 if none
+		bool opening;
+
+		void Move(Sci_Position delta) {
+			position += delta;
+		}
+	};
+	GapVector<Brace> braces[types];
+	std::vector<int> open[types];	// unpaired opening brackets, innermost last
+	Sci_Position length = 0;		// of the document at the last Truncate
+	Sci_Position known = 0;			// end of the text the last Lex got to
+
+	static int TypeOf(int ch) {
+		switch (ch) {
+		case '{': case '}':
+			return 0;
+		case '[': case ']':
+			return 1;
+		case '(': case ')':
+			return 2;
+		}
+		return -1;
+	}
+	static bool IsOpening(int ch) {
+		return ch == '{' || ch == '[' || ch == '(';
+	}
+	static int Link(int from, int to) {
+		return to < 0 ? 0 : to - from;
+	}
+	// First bracket of type at or after position.
+	int LowerBound(int type, Sci_Position position) const {
+		return static_cast<int>(braces[type].LowerBound(0, position,
+			[](const Brace &brace, Sci_Position p) { return brace.position < p; }));
+	}
+	// Removes the brackets after the gap before position, which Lex got to
+	// again.
+	void Drop(int type, Sci_Position position) {
+		GapVector<Brace> &list = braces[type];
+		while (list.Size() > list.GapStart() && list.Get(list.GapStart()).position < position)
+			list.EraseAfterGap();
+	}
+	// Innermost open bracket of type before position whose pair, if any,
+	// closes at or after it.
+	int Enclosing(int type, Sci_Position position) const {
+		const int last = LowerBound(type, position) - 1;
+		if (last < 0)
+			return -1;
+		const Brace brace = braces[type].Get(last);
+		if (brace.opening)
+			return last;
+		return brace.enclosing ? last + brace.enclosing : -1;
+	}
+	void Fill(LexerBraceQuery *query, int type, int index) const {
+		query->open = query->close = -1;
+		if (index < 0)
+			return;
+		const Brace brace = braces[type].Get(index);
+		if (brace.position >= known)
+			return;
+		Sci_Position match = brace.match ? braces[type].Get(index + brace.match).position : -1;
+		if (match >= known)
+			match = -1;
+		query->open = brace.opening ? brace.position : match;
+		query->close = brace.opening ? match : brace.position;
+	}
+	// Pairs the brackets of type kept after the gap which are not inside
+	// another kept one with the brackets still open, as Lex would have.
+	// Once nothing is open, the rest was not paired with anything before
+	// the gap either.
+	void Restore(int type, Sci_Position position) {
+		GapVector<Brace> &list = braces[type];
+		std::vector<int> &stack = open[type];
+		Drop(type, position);
+		for (int i : stack)
+			list[i].match = 0;
+		const int count = static_cast<int>(list.Size());
+		const int gap = static_cast<int>(list.GapStart());
+		for (int i = gap; i < count;) {
+			Brace &brace = list[i];
+			const bool linked = (brace.match && i + brace.match < gap)
+				|| (brace.enclosing && i + brace.enclosing < gap);
+			if (stack.empty() && !linked)
+				break;
+			if (brace.opening) {
+				brace.enclosing = Link(i, stack.empty() ? -1 : stack.back());
+				if (!brace.match)
+					break;
+				i += brace.match;
+				list[i].enclosing = Link(i, stack.empty() ? -1 : stack.back());
+			} else {
+				brace.match = 0;
+				if (!stack.empty()) {
+					brace.match = stack.back() - i;
+					list[stack.back()].match = i - stack.back();
+					stack.pop_back();
+				}
+				list[i].enclosing = Link(i, stack.empty() ? -1 : stack.back());
+			}
+			i++;
+		}
+	}
+public:
+	void Clear() {
+		for (int type = 0; type < types; type++) {
+			braces[type].Clear();
+			open[type].clear();
+		}
+		known = 0;
+	}
+	// Called before Lex starts at position, with the length of the document.
+	void Truncate(Sci_Position position, Sci_Position documentLength) {
+		// text was added or removed after position
+		const Sci_Position delta = documentLength - length;
+		length = documentLength;
+		for (int type = 0; type < types; type++) {
+			GapVector<Brace> &list = braces[type];
+			list.MoveGap(LowerBound(type, position));
+			list.Shift(delta);
+			std::vector<int> &stack = open[type];
+			stack.clear();
+			const int last = static_cast<int>(list.GapStart()) - 1;
+			if (last < 0)
+				continue;
+			const Brace brace = list.Get(last);
+			int i = brace.opening ? last : (brace.enclosing ? last + brace.enclosing : -1);
+			for (; i >= 0; i = list[i].enclosing ? i + list[i].enclosing : -1)
+				stack.push_back(i);
+			std::reverse(stack.begin(), stack.end());
+		}
+	}
+	// Called for every operator, ignores the ones which are not brackets.
+	void Add(Sci_Position position, int ch) {
+		const int type = TypeOf(ch);
+		if (type < 0)
+			return;
+		GapVector<Brace> &list = braces[type];
+		std::vector<int> &stack = open[type];
+		Drop(type, position + 1);
+		const int index = static_cast<int>(list.GapStart());
+		Brace brace = { position, 0, 0, IsOpening(ch) };
+		if (brace.opening) {
+			brace.enclosing = Link(index, stack.empty() ? -1 : stack.back());
+			stack.push_back(index);
+		} else if (!stack.empty()) {
+			brace.match = stack.back() - index;
+			list[stack.back()].match = index - stack.back();
+			stack.pop_back();
+			brace.enclosing = Link(index, stack.empty() ? -1 : stack.back());
+		}
+		list.Insert(brace);
+	}
+	// Called after Lex got to position, for the brackets kept after it,
+	// with the end of the range Lex styled. The text up to there is taken
+	// to be the one they were found in.
+	void Restore(Sci_Position position, Sci_Position end) {
+		for (int type = 0; type < types; type++)
+			Restore(type, position);
+		known = end;
+	}
+	// Answers a LEXER_CALL_BRACE_* PrivateCall.
+	LexerBraceQuery *Query(int operation, LexerBraceQuery *query) const {
+		query->open = query->close = -1;
+		if (query->position >= known)
+			return query;
+		if (operation == LEXER_CALL_BRACE_MATCH) {
+			for (int type = 0; type < types; type++) {
+				const int index = LowerBound(type, query->position);
+				if (index < static_cast<int>(braces[type].Size())
+					&& braces[type].Get(index).position == query->position) {
+					Fill(query, type, index);
+					break;
+				}
+			}
+			return query;
+		}
+		const int only = TypeOf(query->brace);
+		int bestType = -1;
+		int best = -1;
+		Sci_Position bestPosition = -1;
+		for (int type = 0; type < types; type++) {
+			if (only >= 0 && type != only)
+				continue;
+			const int index = Enclosing(type, query->position);
+			if (index >= 0 && braces[type].Get(index).position > bestPosition) {
+				bestType = type;
+				best = index;
+				bestPosition = braces[type].Get(index).position;
+			}
+		}
+		Fill(query, bestType, best);
+		return query;
+	}
+};
+
+#endif // BRACEINDEX_H
@@ -0,0 +1,216 @@
+/*
+ * Copyright 2018-2019 Kacper Kasper <kacperkasper@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+#ifndef BYTECONTEXT_H
+#define BYTECONTEXT_H
+
+#include <ILexer.h>
+
+#include "LexAccessor.h"
+
+#include "RunSkip.h"
+
+// Drop-in replacement for StyleContext, as far as the lexers in this
+// package use it, that is cheaper on mostly ASCII text.
+//
+// Text is read in blocks which are checked for non-ASCII bytes once. In a
+// plain block characters are bytes, line ends are found by looking at
+// them instead of asking the document about every line, and SkipRun moves
+// over whole runs without updating the context for each character. Other
+// blocks decode characters through IDocument::GetCharacterAndWidth like
+// StyleContext does, so the result is always identical.
+class ByteContext {
+	enum { blockSize = 4096 };
+	Lexilla::LexAccessor &styler;
+	Scintilla::IDocument *pAccess;
+	bool multiByte;
+	Sci_PositionU lengthDocument;
+	Sci_PositionU endPos;
+	char block[blockSize];
+	Sci_PositionU blockStart;
+	Sci_PositionU blockLength;
+	bool blockPlain;
+
+	void Fill(Sci_PositionU position) {
+		blockStart = position;
+		blockLength = 0;
+		if (position < lengthDocument) {
+			blockLength = lengthDocument - position;
+			if (blockLength > blockSize)
+				blockLength = blockSize;
+			pAccess->GetCharRange(block, position, blockLength);
+		}
+		unsigned char combined = 0;
+		for (Sci_PositionU i = 0; i < blockLength; i++)
+			combined |= static_cast<unsigned char>(block[i]);
+		blockPlain = !multiByte || combined < 0x80;
+	}
+	bool InBlock(Sci_PositionU position) const {
+		return position - blockStart < blockLength;
+	}
+	int ByteAt(Sci_PositionU position) {
+		if (position >= lengthDocument)
+			return 0;
+		if (!InBlock(position))
+			Fill(position);
+		return static_cast<unsigned char>(block[position - blockStart]);
+	}
+	void GetNextChar() {
+		const Sci_PositionU position = currentPos + width;
+		if (InBlock(position) && blockPlain) {
+			chNext = static_cast<unsigned char>(block[position - blockStart]);
+			widthNext = 1;
+		} else {
+			chNext = ByteAt(position);
+			widthNext = 1;
+			if (chNext >= 0x80 && multiByte)
+				chNext = pAccess->GetCharacterAndWidth(position, &widthNext);
+		}
+		// only line ends of type SC_LINE_END_TYPE_DEFAULT are supported
+		atLineEnd = ch == '\n' || (ch == '\r' && chNext != '\n')
+			|| currentPos >= lengthDocument;
+	}
+public:
+	Sci_PositionU currentPos;
+	Sci_Position currentLine;
+	bool atLineStart;
+	bool atLineEnd;
+	int state;
+	int chPrev;
+	int ch;
+	Sci_Position width;
+	int chNext;
+	Sci_Position widthNext;
+
+	ByteContext(Sci_PositionU startPos, Sci_PositionU length, int initStyle, Lexilla::LexAccessor &styler_, char chMask = '\377') :
+		styler(styler_), pAccess(styler_.MultiByteAccess()),
+		multiByte(styler_.Encoding() != Lexilla::EncodingType::eightBit),
+		lengthDocument(static_cast<Sci_PositionU>(styler_.Length())),
+		endPos(startPos + length), blockStart(0), blockLength(0), blockPlain(false),
+		currentPos(startPos), currentLine(0), atLineStart(true), atLineEnd(false),
+		state(initStyle & chMask), chPrev(0), ch(0), width(0), chNext(0), widthNext(1) {
+		styler.StartAt(startPos);
+		styler.StartSegment(startPos);
+		currentLine = styler.GetLine(startPos);
+		atLineStart = static_cast<Sci_PositionU>(styler.LineStart(currentLine)) == startPos;
+		if (endPos == lengthDocument)
+			endPos++;
+		GetNextChar();
+		ch = chNext;
+		width = widthNext;
+		GetNextChar();
+	}
+	ByteContext(const ByteContext &) = delete;
+	ByteContext &operator=(const ByteContext &) = delete;
+
+	void Complete() {
+		styler.ColourTo(currentPos - ((currentPos > lengthDocument) ? 2 : 1), state);
+		styler.Flush();
+	}
+	bool More() const {
+		return currentPos < endPos;
+	}
+	void Forward() {
+		if (currentPos < endPos) {
+			atLineStart = atLineEnd;
+			if (atLineStart)
+				currentLine++;
+			chPrev = ch;
+			currentPos += width;
+			ch = chNext;
+			width = widthNext;
+			GetNextChar();
+		} else {
+			atLineStart = false;
+			chPrev = ' ';
+			ch = ' ';
+			chNext = ' ';
+			atLineEnd = true;
+		}
+	}
+	void Forward(Sci_Position count) {
+		for (Sci_Position i = 0; i < count; i++)
+			Forward();
+	}
+	// Same as calling Forward while More and the character is in stay.
+	// Inside plain blocks this only looks at bytes.
+	bool SkipWhile(const CharClass &stay) {
+		if (!More() || !stay.Contains(ch))
+			return false;
+		if (blockPlain && InBlock(currentPos) && width == 1) {
+			// keep one byte of lookahead inside the block for chNext
+			Sci_PositionU last = blockStart + blockLength - 1;
+			if (last > endPos)
+				last = endPos;
+			Sci_PositionU position = currentPos;
+			Sci_Position lines = 0;
+			while (position < last
+				&& stay.Contains(static_cast<unsigned char>(block[position - blockStart]))) {
+				const char c = block[position - blockStart];
+				if (c == '\n' || (c == '\r' && block[position + 1 - blockStart] != '\n'))
+					lines++;
+				position++;
+			}
+			if (position > currentPos) {
+				const Sci_PositionU offset = position - blockStart;
+				chPrev = static_cast<unsigned char>(block[offset - 1]);
+				ch = static_cast<unsigned char>(block[offset]);
+				atLineStart = chPrev == '\n' || (chPrev == '\r' && ch != '\n');
+				currentLine += lines;
+				currentPos = position;
+				width = 1;
+				GetNextChar();
+			}
+		}
+		while (More() && stay.Contains(ch))
+			Forward();
+		return true;
+	}
+	void ChangeState(int state_) {
+		state = state_;
+	}
+	void SetState(int state_) {
+		styler.ColourTo(currentPos - ((currentPos > lengthDocument) ? 2 : 1), state);
+		state = state_;
+	}
+	void ForwardSetState(int state_) {
+		Forward();
+		SetState(state_);
+	}
+	bool Match(char ch0) const {
+		return ch == static_cast<unsigned char>(ch0);
+	}
+	bool Match(char ch0, char ch1) const {
+		return (ch == static_cast<unsigned char>(ch0)) && (chNext == static_cast<unsigned char>(ch1));
+	}
+	bool Match(const char *s) {
+		if (ch != static_cast<unsigned char>(*s))
+			return false;
+		s++;
+		if (!*s)
+			return true;
+		if (chNext != static_cast<unsigned char>(*s))
+			return false;
+		s++;
+		for (int n = 2; *s; n++) {
+			if (static_cast<unsigned char>(*s) != ByteAt(currentPos + n))
+				return false;
+			s++;
+		}
+		return true;
+	}
+	void GetCurrent(char *s, Sci_PositionU len) {
+		styler.GetRange(styler.GetStartSegment(), currentPos, s, len);
+	}
+	void GetCurrentLowered(char *s, Sci_PositionU len) {
+		styler.GetRangeLowered(styler.GetStartSegment(), currentPos, s, len);
+	}
+};
+
+template <>
+inline bool SkipRun<ByteContext>(ByteContext &sc, const CharClass &stay) {
+	return sc.SkipWhile(stay);
+}
+
+#endif // BYTECONTEXT_H
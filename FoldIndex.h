@@ -0,0 +1,134 @@
+/*
+ * Copyright 2018-2019 Kacper Kasper <kacperkasper@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+#ifndef FOLDINDEX_H
+#define FOLDINDEX_H
+
+#include <algorithm>
+#include <vector>
+
+#include "common.h"
+
+// Fold ranges of a document, kept next to the levels written by Fold so
+// that hosts can find folds without walking every line.
+//
+// Folds are stored in order of their header lines. Fold reports every line
+// it writes a level for, which closes the open folds at or above that level
+// and opens one if the line is a header. When Fold starts again at some
+// line, the folds from there on are dropped and the ones that line closed
+// are opened again, so the cost follows the folded range.
+//
+// The folds after the last line Fold gets to are not kept moved with the
+// text: the lexer is not told where the document was edited, and with two
+// edits before a Fold the lines between them only moved by one of them.
+// They are found again when a later Fold gets to them. Until then the
+// folds going on at that line have no end line, as LexerFold documents.
+class FoldIndex {
+	std::vector<LexerFold> folds;
+	std::vector<int> open;	// folds without an end line yet, innermost last
+	std::vector<int> byKind[LEXER_FOLD_KINDS];
+
+	bool Covers(const LexerFold &fold, Sci_Position line) const {
+		return fold.startLine <= line && (fold.endLine < 0 || fold.endLine >= line);
+	}
+	// Fold numbers of kind, or all folds for LEXER_FOLD_ANY. Searches go
+	// through FoldAt so both cases share the code.
+	int Count(int kind) const {
+		return kind == LEXER_FOLD_ANY ? static_cast<int>(folds.size())
+			: static_cast<int>(byKind[kind].size());
+	}
+	int FoldAt(int kind, int n) const {
+		return kind == LEXER_FOLD_ANY ? n : byKind[kind][n];
+	}
+	// Position of the first fold of kind whose header is after line.
+	int UpperBound(int kind, Sci_Position line) const {
+		int low = 0;
+		int high = Count(kind);
+		while (low < high) {
+			const int middle = low + (high - low) / 2;
+			if (folds[FoldAt(kind, middle)].startLine <= line)
+				low = middle + 1;
+			else
+				high = middle;
+		}
+		return low;
+	}
+public:
+	void Clear() {
+		folds.clear();
+		open.clear();
+		for (std::vector<int> &kind : byKind)
+			kind.clear();
+	}
+	// Called before Fold starts at line.
+	void Truncate(Sci_Position line) {
+		const auto first = std::lower_bound(folds.begin(), folds.end(), line,
+			[](const LexerFold &fold, Sci_Position l) { return fold.startLine < l; });
+		folds.erase(first, folds.end());
+		const int count = static_cast<int>(folds.size());
+		for (std::vector<int> &kind : byKind) {
+			while (!kind.empty() && kind.back() >= count)
+				kind.pop_back();
+		}
+		// Folds still open at line all enclose the last remaining one.
+		// Those which ended right before it were closed by line itself.
+		open.clear();
+		for (int i = count - 1; i >= 0; i = folds[i].parent) {
+			if (folds[i].endLine < 0 || folds[i].endLine >= line - 1) {
+				folds[i].endLine = -1;
+				open.push_back(i);
+			}
+		}
+		std::reverse(open.begin(), open.end());
+	}
+	void Line(Sci_Position line, int level, bool header, int kind) {
+		while (!open.empty() && folds[open.back()].level >= level) {
+			folds[open.back()].endLine = line - 1;
+			open.pop_back();
+		}
+		if (header) {
+			const int index = static_cast<int>(folds.size());
+			folds.push_back({ line, -1, level, kind, open.empty() ? -1 : open.back() });
+			byKind[kind].push_back(index);
+			open.push_back(index);
+		}
+	}
+	// Innermost fold of kind containing line. The folds containing a line
+	// all enclose the last fold starting at or before it.
+	int Containing(int kind, Sci_Position line) const {
+		int i = UpperBound(LEXER_FOLD_ANY, line) - 1;
+		while (i >= 0) {
+			if (Covers(folds[i], line) && (kind == LEXER_FOLD_ANY || folds[i].kind == kind))
+				break;
+			i = folds[i].parent;
+		}
+		return i;
+	}
+	int Next(int kind, Sci_Position line) const {
+		const int n = UpperBound(kind, line);
+		return n < Count(kind) ? FoldAt(kind, n) : -1;
+	}
+	int Previous(int kind, Sci_Position line) const {
+		const int n = UpperBound(kind, line - 1);
+		return n > 0 ? FoldAt(kind, n - 1) : -1;
+	}
+	// Answers a LEXER_CALL_FOLD_* PrivateCall.
+	LexerFoldQuery *Query(int operation, LexerFoldQuery *query) const {
+		if (query->kind < LEXER_FOLD_ANY || query->kind >= LEXER_FOLD_KINDS)
+			query->index = -1;
+		else if (operation == LEXER_CALL_FOLD_AT)
+			query->index = Containing(query->kind, query->line);
+		else if (operation == LEXER_CALL_FOLD_NEXT)
+			query->index = Next(query->kind, query->line);
+		else if (operation == LEXER_CALL_FOLD_PREVIOUS)
+			query->index = Previous(query->kind, query->line);
+		else if (query->index >= static_cast<int>(folds.size()))
+			query->index = -1;
+		if (query->index >= 0)
+			query->fold = folds[query->index];
+		return query;
+	}
+};
+
+#endif // FOLDINDEX_H
@@ -0,0 +1,100 @@
+/*
+ * Copyright 2018-2019 Kacper Kasper <kacperkasper@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+#ifndef GAPVECTOR_H
+#define GAPVECTOR_H
+
+#include <algorithm>
+#include <vector>
+
+#include <ILexer.h>
+
+// Vector with a gap where the lexers add and remove, like Scintilla's
+// SplitVector. The elements after the gap were found by earlier calls and
+// still have to be moved by shift. T::Move(delta) moves an element when it
+// crosses the gap, so after an edit the rest of the document is moved by
+// changing shift alone and the cost follows what is lexed.
+template <typename T>
+class GapVector {
+	std::vector<T> body;
+	size_t gapStart;
+	size_t gapLength;
+	Sci_Position shift;
+public:
+	GapVector() : gapStart(0), gapLength(0), shift(0) {
+	}
+	void Clear() {
+		body.clear();
+		gapStart = 0;
+		gapLength = 0;
+		shift = 0;
+	}
+	size_t Size() const {
+		return body.size() - gapLength;
+	}
+	size_t GapStart() const {
+		return gapStart;
+	}
+	// Element i as stored, for changing anything but what Move changes.
+	T &operator[](size_t i) {
+		return body[i < gapStart ? i : i + gapLength];
+	}
+	// Element i where it is now.
+	T Get(size_t i) const {
+		if (i < gapStart)
+			return body[i];
+		T element = body[i + gapLength];
+		element.Move(shift);
+		return element;
+	}
+	// Moves the elements after the gap.
+	void Shift(Sci_Position delta) {
+		shift += delta;
+	}
+	void MoveGap(size_t position) {
+		for (; gapStart > position; gapStart--) {
+			T element = body[gapStart - 1];
+			element.Move(-shift);
+			body[gapStart - 1 + gapLength] = element;
+		}
+		for (; gapStart < position; gapStart++) {
+			T element = body[gapStart + gapLength];
+			element.Move(shift);
+			body[gapStart] = element;
+		}
+	}
+	// Adds element at the start of the gap, making the gap larger if needed.
+	void Insert(const T &element) {
+		if (gapLength == 0) {
+			if (gapStart == body.size()) {
+				body.push_back(element);
+				gapStart++;
+				return;
+			}
+			gapLength = std::max<size_t>(16, body.size() / 8);
+			body.insert(body.begin() + gapStart, gapLength, T());
+		}
+		body[gapStart++] = element;
+		gapLength--;
+	}
+	// Removes the first count elements after the gap.
+	void EraseAfterGap(size_t count = 1) {
+		gapLength += count;
+	}
+	// First element which is not less than value, using less(element, value).
+	template <typename Value, typename Less>
+	size_t LowerBound(size_t low, const Value &value, Less less) const {
+		size_t high = Size();
+		while (low < high) {
+			const size_t middle = low + (high - low) / 2;
+			if (less(Get(middle), value))
+				low = middle + 1;
+			else
+				high = middle;
+		}
+		return low;
+	}
+};
+
+#endif // GAPVECTOR_H
@@ -0,0 +1,227 @@
+/*
+ * Copyright 2018-2019 Kacper Kasper <kacperkasper@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+#ifndef KEYWORDSET_H
+#define KEYWORDSET_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+// A word list compiled into a hash table which is looked up where it lies.
+//
+// The compiled form holds no pointers, so it can be written to a file,
+// mapped back in later and attached to a lexer, which then never parses
+// the list. It is made of 32-bit words in the byte order of the machine:
+//
+//	magic			KEYWORDSET_MAGIC
+//	flags			KEYWORDSET_FOLDED if the words were lowercased
+//	bucketCount		a power of two
+//	entryCount		all entries, prefixes included
+//	prefixCount		entries of words which started with '^', last
+//	size			in bytes, of everything
+//	buckets			bucketCount + 1 entry numbers: bucket b holds entries
+//					buckets[b] up to buckets[b + 1], of words with a hash
+//					of b modulo bucketCount
+//	entries			hash and offset of the word from the start, for each
+//	words			each ending with '\0', prefixes without their '^'
+//
+// The hash is 32-bit FNV-1a. As with WordList a word starting with '^'
+// matches everything it is a prefix of.
+enum {
+	KEYWORDSET_MAGIC = 0x3153574b,	// "KWS1"
+	KEYWORDSET_FOLDED = 1
+};
+
+class KeywordSet {
+	enum { headerWords = 6 };
+	struct Entry {
+		uint32_t hash;
+		uint32_t offset;
+	};
+	std::string text;				// as given to Set
+	std::vector<uint32_t> owned;	// compiled from text
+	const uint32_t *set;			// owned, or attached memory
+	size_t size;
+
+	static uint32_t Hash(const char *word, size_t length) {
+		uint32_t hash = 2166136261u;
+		for (size_t i = 0; i < length; i++)
+			hash = (hash ^ static_cast<unsigned char>(word[i])) * 16777619u;
+		return hash;
+	}
+	static bool IsSpace(char ch) {
+		return ch == ' ' || ch == '\t' || ch == '\r' || ch == '\n';
+	}
+	const Entry *Entries() const {
+		return reinterpret_cast<const Entry *>(set + headerWords + set[2] + 1);
+	}
+	const char *Word(const Entry &entry) const {
+		return reinterpret_cast<const char *>(set) + entry.offset;
+	}
+	void Compile(bool fold) {
+		std::vector<std::string> words, prefixes;
+		for (size_t i = 0; i < text.length();) {
+			while (i < text.length() && IsSpace(text[i]))
+				i++;
+			const size_t start = i;
+			while (i < text.length() && !IsSpace(text[i]))
+				i++;
+			if (i == start)
+				continue;
+			std::string word(text, start, i - start);
+			if (fold) {
+				for (char &ch : word) {
+					if (ch >= 'A' && ch <= 'Z')
+						ch = ch - 'A' + 'a';
+				}
+			}
+			if (word[0] == '^')
+				prefixes.push_back(word.substr(1));
+			else
+				words.push_back(word);
+		}
+		uint32_t bucketCount = 1;
+		while (bucketCount < words.size())
+			bucketCount *= 2;
+		const size_t entryCount = words.size() + prefixes.size();
+		const size_t wordsStart = (headerWords + bucketCount + 1 + entryCount * 2) * 4;
+		size_t end = wordsStart;
+		for (const std::string &word : words)
+			end += word.length() + 1;
+		for (const std::string &prefix : prefixes)
+			end += prefix.length() + 1;
+		// keeps the last byte a '\0' even without words, see Attach
+		end = (end + 4) / 4 * 4;
+
+		owned.assign(end / 4, 0);
+		owned[0] = KEYWORDSET_MAGIC;
+		owned[1] = fold ? KEYWORDSET_FOLDED : 0;
+		owned[2] = bucketCount;
+		owned[3] = entryCount;
+		owned[4] = prefixes.size();
+		owned[5] = end;
+		// counting sort of the words by bucket
+		uint32_t *buckets = &owned[headerWords];
+		for (const std::string &word : words)
+			buckets[(Hash(word.c_str(), word.length()) & (bucketCount - 1)) + 1]++;
+		for (uint32_t b = 0; b < bucketCount; b++)
+			buckets[b + 1] += buckets[b];
+		std::vector<uint32_t> next(buckets, buckets + bucketCount);
+		Entry *entries = reinterpret_cast<Entry *>(buckets + bucketCount + 1);
+		char *base = reinterpret_cast<char *>(owned.data());
+		size_t offset = wordsStart;
+		for (const std::string &word : words) {
+			const uint32_t hash = Hash(word.c_str(), word.length());
+			entries[next[hash & (bucketCount - 1)]++] = { hash, static_cast<uint32_t>(offset) };
+			memcpy(base + offset, word.c_str(), word.length() + 1);
+			offset += word.length() + 1;
+		}
+		for (size_t i = 0; i < prefixes.size(); i++) {
+			entries[words.size() + i] = { 0, static_cast<uint32_t>(offset) };
+			memcpy(base + offset, prefixes[i].c_str(), prefixes[i].length() + 1);
+			offset += prefixes[i].length() + 1;
+		}
+		set = owned.data();
+		size = end;
+	}
+public:
+	KeywordSet() : set(nullptr), size(0) {
+		Compile(false);
+	}
+	KeywordSet(const KeywordSet &other) : text(other.text), owned(other.owned),
+		set(other.set == other.owned.data() ? owned.data() : other.set), size(other.size) {
+	}
+	KeywordSet &operator=(const KeywordSet &) = delete;
+
+	// Compiles the whitespace separated words of text, lowercased if fold.
+	// Returns false if that is what the set already holds.
+	bool Set(const char *text_, bool fold) {
+		if (set == owned.data() && text == text_ && ((set[1] & KEYWORDSET_FOLDED) != 0) == fold)
+			return false;
+		text = text_;
+		Compile(fold);
+		return true;
+	}
+	// Uses the compiled set at data, which has to stay there unchanged for
+	// as long as it is used. Returns false, leaving the set as it is, if
+	// data does not hold a set matching fold.
+	bool Attach(const void *data, size_t length, bool fold) {
+		const uint32_t *header = static_cast<const uint32_t *>(data);
+		if (!data || reinterpret_cast<uintptr_t>(data) % 4 != 0 || length < headerWords * 4
+			|| header[0] != KEYWORDSET_MAGIC || header[1] != (fold ? KEYWORDSET_FOLDED : 0)
+			|| header[5] != length)
+			return false;
+		const uint64_t bucketCount = header[2];
+		const uint64_t entryCount = header[3];
+		const uint64_t prefixCount = header[4];
+		if (bucketCount == 0 || (bucketCount & (bucketCount - 1)) != 0 || prefixCount > entryCount
+			|| (headerWords + bucketCount + 1 + entryCount * 2) * 4 > length)
+			return false;
+		// words are compared with strcmp, which stops at the last byte at
+		// the latest
+		const char *bytes = static_cast<const char *>(data);
+		if (bytes[length - 1] != '\0')
+			return false;
+		const uint32_t *buckets = header + headerWords;
+		if (buckets[0] != 0 || buckets[bucketCount] != entryCount - prefixCount)
+			return false;
+		for (uint64_t b = 0; b < bucketCount; b++) {
+			if (buckets[b] > buckets[b + 1])
+				return false;
+		}
+		const Entry *entries = reinterpret_cast<const Entry *>(buckets + bucketCount + 1);
+		for (uint64_t i = 0; i < entryCount; i++) {
+			if (entries[i].offset >= length)
+				return false;
+		}
+		text.clear();
+		owned.clear();
+		set = header;
+		size = length;
+		return true;
+	}
+	bool InList(const char *s) const {
+		const size_t length = strlen(s);
+		const uint32_t hash = Hash(s, length);
+		const uint32_t *buckets = set + headerWords;
+		const uint32_t bucket = hash & (set[2] - 1);
+		const Entry *entries = Entries();
+		for (uint32_t i = buckets[bucket]; i < buckets[bucket + 1]; i++) {
+			if (entries[i].hash == hash && strcmp(Word(entries[i]), s) == 0)
+				return true;
+		}
+		for (uint32_t i = set[3] - set[4]; i < set[3]; i++) {
+			const char *prefix = Word(entries[i]);
+			if (strncmp(prefix, s, strlen(prefix)) == 0)
+				return true;
+		}
+		return false;
+	}
+	// The words of the set as Set takes them, prefixes with their '^',
+	// lowercased if they were. Also works for an attached set.
+	std::string Words() const {
+		std::string words;
+		const Entry *entries = Entries();
+		for (uint32_t i = 0; i < set[3]; i++) {
+			if (i > 0)
+				words += ' ';
+			if (i >= set[3] - set[4])
+				words += '^';
+			words += Word(entries[i]);
+		}
+		return words;
+	}
+	const void *Data() const {
+		return set;
+	}
+	size_t Size() const {
+		return size;
+	}
+};
+
+#endif // KEYWORDSET_H
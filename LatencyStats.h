@@ -0,0 +1,122 @@
+/*
+ * Copyright 2018-2019 Kacper Kasper <kacperkasper@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+#ifndef LATENCYSTATS_H
+#define LATENCYSTATS_H
+
+#include <algorithm>
+#include <chrono>
+
+#include "common.h"
+
+// Keeps the durations of the most recent calls in a ring so that
+// percentiles can be computed without allocating.
+class LatencyRecorder {
+	enum { sampleCount = 256 };
+	double samples[sampleCount];
+	int next;
+	int count;
+public:
+	LatencyRecorder() : next(0), count(0) {
+	}
+	void Reset() {
+		next = 0;
+		count = 0;
+	}
+	void Add(double microseconds) {
+		samples[next] = microseconds;
+		next = (next + 1) % sampleCount;
+		if (count < sampleCount)
+			count++;
+	}
+	// Adds to the most recent sample, used to charge Fold to the Lex call
+	// it follows.
+	void AddToLast(double microseconds) {
+		if (count == 0) {
+			Add(microseconds);
+			return;
+		}
+		samples[(next + sampleCount - 1) % sampleCount] += microseconds;
+	}
+	int Count() const {
+		return count;
+	}
+	double Percentile(int percent) const {
+		if (count == 0)
+			return 0;
+		double sorted[sampleCount];
+		std::copy(samples, samples + count, sorted);
+		const int index = std::min(count - 1, count * percent / 100);
+		std::nth_element(sorted, sorted + index, sorted + count);
+		return sorted[index];
+	}
+};
+
+// Lex, Fold and combined (one Lex and the Fold after it, as Scintilla
+// does on every edit) latencies of a lexer instance. Nothing is recorded
+// until Reset, so the clock is only read while someone is measuring.
+class LatencyStats {
+	LatencyRecorder lex;
+	LatencyRecorder fold;
+	LatencyRecorder total;
+	bool recording;
+public:
+	LatencyStats() : recording(false) {
+	}
+	// Forgets the recorded latencies and starts recording.
+	void Reset() {
+		lex.Reset();
+		fold.Reset();
+		total.Reset();
+		recording = true;
+	}
+	void Stop() {
+		recording = false;
+	}
+	bool Recording() const {
+		return recording;
+	}
+	void AddLex(double microseconds) {
+		lex.Add(microseconds);
+		total.Add(microseconds);
+	}
+	void AddFold(double microseconds) {
+		fold.Add(microseconds);
+		total.AddToLast(microseconds);
+	}
+	LexerLatency *Fill(LexerLatency *latency) const {
+		latency->samples = total.Count();
+		latency->lexP50 = lex.Percentile(50);
+		latency->lexP99 = lex.Percentile(99);
+		latency->foldP50 = fold.Percentile(50);
+		latency->foldP99 = fold.Percentile(99);
+		latency->totalP50 = total.Percentile(50);
+		latency->totalP99 = total.Percentile(99);
+		return latency;
+	}
+};
+
+// Measures the lifetime of the object and reports it to one of the
+// LatencyStats members, if they are recording.
+class LatencyTimer {
+	LatencyStats &stats;
+	void (LatencyStats::*add)(double);
+	bool recording;
+	std::chrono::steady_clock::time_point start;
+public:
+	LatencyTimer(LatencyStats &stats_, void (LatencyStats::*add_)(double)) :
+		stats(stats_), add(add_), recording(stats_.Recording()) {
+		if (recording)
+			start = std::chrono::steady_clock::now();
+	}
+	~LatencyTimer() {
+		if (!recording)
+			return;
+		const std::chrono::duration<double, std::micro> elapsed =
+			std::chrono::steady_clock::now() - start;
+		(stats.*add)(elapsed.count());
+	}
+};
+
+#endif // LATENCYSTATS_H
@@ -8,10 +8,10 @@
 #include <assert.h>
 #include <ctype.h>
 
+#include <algorithm>
 #include <map>
 #include <string>
 #include <vector>
-#include <stdexcept>
 
 #include <ILexer.h>
 #include <Scintilla.h>
@@ -27,6 +27,22 @@
 #include "DefaultLexer.h"
 
 #include "common.h"
+#include "LatencyStats.h"
+#include "StyleBuffer.h"
+#include "WorkBudget.h"
+#include "RunSkip.h"
+#include "ByteContext.h"
+#include "FoldIndex.h"
+#include "BraceIndex.h"
+#include "LexerStream.h"
+#include "TokenStream.h"
+#include "WordMemo.h"
+#include "Published.h"
+#include "KeywordSet.h"
+#include "RunIndex.h"
+#ifdef LEXER_VERIFY
+#include "test/DualRun.h"
+#endif
 
 using namespace Scintilla;
 using namespace Lexilla;
@@ -35,6 +51,20 @@ static const char LexerName[] = "jam";
 
 enum kwType { kwOther, kwLocal, kwFor };
 
+// Lexer state at the position where the last Lex call stopped. Restored
+// when the next call starts there, so lexing can be split across calls.
+struct ResumeJam {
+	Sci_Position position;
+	int style;
+	kwType kwLast;
+	int varLastStyle;
+
+	bool Same(const ResumeJam &other) const {
+		return style == other.style && kwLast == other.kwLast
+			&& varLastStyle == other.varLastStyle;
+	}
+};
+
 enum {
 	SCE_JAM_DEFAULT,
 	SCE_JAM_COMMENT,
@@ -48,7 +78,7 @@ enum {
 
 static const char styleSubable[] = { SCE_JAM_IDENTIFIER, SCE_JAM_VARIABLE, 0 };
 
-LexicalClass lexicalClasses[] = {
+static const LexicalClass lexicalClasses[] = {
 	// Lexer Jam SCLEX_JAM SCE_JAM_:
 	0, "SCE_JAM_DEFAULT", "default", "White space",
 	1, "SCE_JAM_COMMENT", "comment line", "Comment",
@@ -60,28 +90,81 @@ LexicalClass lexicalClasses[] = {
 	7, "SCE_JAM_VARIABLE", "variable", "Variables",
 };
 
+// Same characters as lexlib's isoperator
+static constexpr CharClass jamOperator = CharClass::Of("%^&*()-+=|{}[]:;<>,/?!.~");
+static constexpr CharClass jamAlnum = CharClass::Range('0', '9')
+	| CharClass::Range('A', 'Z') | CharClass::Range('a', 'z');
+// Ends an identifier. Wide characters are left to the lexer, which only
+// looks at their low byte.
+static constexpr CharClass jamIdentifierEnd = CharClass::Of(" \t$@\n\r]")
+	| (jamOperator - CharClass::Of("-")) | CharClass::Wide();
+
+static constexpr RunRule jamRunRules[] = {
+	{ SCE_JAM_DEFAULT, ~(CharClass::Of("#\"@$") | jamOperator | jamAlnum | CharClass::NonASCII()) },
+	{ SCE_JAM_COMMENT, ~CharClass::Of("\r\n") },
+	{ SCE_JAM_STRING, ~CharClass::Of("\"$") },
+	{ SCE_JAM_VARIABLE, ~CharClass::Of(")") },
+	{ SCE_JAM_IDENTIFIER, ~jamIdentifierEnd },
+};
+static constexpr RunTable<SCE_JAM_VARIABLE + 1> jamRuns(jamRunRules);
+// The token stream needs to see every line start.
+static constexpr RunTable<SCE_JAM_VARIABLE + 1> jamLineRuns = jamRuns.Without(CharClass::Of("\r\n"));
+
+// Identifiers start with an alphanumeric character, so unlike std::stoi
+// there is no need to handle leading white space or a sign.
 inline bool IsANumber(const char* s)
 {
-	size_t index;
-	try {
-		std::stoi(s, &index);
-	} catch (std::invalid_argument&) {
+	if (*s == '\0')
 		return false;
+	for (; *s != '\0'; s++) {
+		if (!IsADigit(*s))
+			return false;
 	}
-	if(index != strlen(s))
-		return false;
 	return true;
 }
 
+static bool IsCommentLine(Sci_Position line, LexAccessor &styler) {
+	Sci_Position pos = styler.LineStart(line);
+	Sci_Position eol_pos = styler.LineStart(line + 1) - 1;
+	for (Sci_Position i = pos; i < eol_pos; i++) {
+		char ch = styler[i];
+		if (ch == '#')
+			return true;
+		else if (ch != ' ' && ch != '\t')
+			return false;
+	}
+	return false;
+}
+
 struct OptionsJam {
 	bool fold;
 	bool foldComment;
 	bool foldCompact;
+	int hugeThreshold;
+	int hugeMaxWork;
+	int styleBufferSize;
+	int budgetBytes;
+	int budgetMilliseconds;
+	bool tokenStream;
+	bool tokenRuns;
+#ifdef LEXER_VERIFY
+	bool verify;
+#endif
 
 	OptionsJam() {
 		fold = false;
 		foldComment = false;
 		foldCompact = true;
+		hugeThreshold = 16 * 1024 * 1024;
+		hugeMaxWork = 1024 * 1024;
+		styleBufferSize = 256 * 1024;
+		budgetBytes = 0;
+		budgetMilliseconds = 0;
+		tokenStream = false;
+		tokenRuns = false;
+#ifdef LEXER_VERIFY
+		verify = false;
+#endif
 	}
 };
 
@@ -98,20 +181,109 @@ struct OptionSetJam : public OptionSet<OptionsJam> {
 
 		DefineProperty("fold.compact", &OptionsJam::foldCompact);
 
+		DefineProperty("lexer.jam.huge.threshold", &OptionsJam::hugeThreshold,
+			"Documents of at least this many bytes are styled in reduced mode: "
+			"no substyles, no comment folding and simplified numbers. "
+			"Set to 0 to always use full mode.");
+
+		DefineProperty("lexer.jam.huge.max.work", &OptionsJam::hugeMaxWork,
+			"In reduced mode, the maximum number of bytes styled or folded by a single call. "
+			"The range is extended to the end of the line it ends in.");
+
+		DefineProperty("lexer.jam.style.buffer.size", &OptionsJam::styleBufferSize,
+			"Largest number of styles collected before they are written to the document. The "
+			"buffer is only as large as the ranges lexed so far need. "
+			"Set to 0 to write them as soon as Scintilla's own small buffer fills up.");
+
+		DefineProperty("lexer.jam.budget.bytes", &OptionsJam::budgetBytes,
+			"Stop lexing at the first line start after this many bytes. "
+			"The position reached is reported through PrivateCall and lexing can continue from there. "
+			"0 means no limit.");
+
+		DefineProperty("lexer.jam.budget.milliseconds", &OptionsJam::budgetMilliseconds,
+			"Stop lexing at the first line start after this much time has passed. 0 means no limit.");
+
+		DefineProperty("lexer.jam.token.stream", &OptionsJam::tokenStream,
+			"Remember the state at the end of every line, so that after an edit lexing stops "
+			"as soon as it gets to text which only moved. Takes memory for every line, and hashing "
+			"every line lexed makes styling long ranges slower, so it is off by default.");
+
+		DefineProperty("lexer.jam.token.runs", &OptionsJam::tokenRuns,
+			"Record the runs of characters of the same style, which hosts can get through "
+			"PrivateCall instead of reading styles. Takes memory for every token.");
+
+#ifdef LEXER_VERIFY
+		DefineProperty("lexer.jam.verify", &OptionsJam::verify,
+			"Lex and fold everything a second time with all fast paths turned off, and "
+			"compare the results. Differences and the time taken by both are reported "
+			"through PrivateCall. Only meant for testing.");
+#endif
+
 		DefineWordListSets(jamWordListDesc);
 	}
 };
 
+// Word lists and substyles as seen by Lex. The host changes its own copy,
+// Lex gets a new one published on every change, see Published.
+struct TablesJam {
+	KeywordSet keywords;
+	SubStyles subStyles;
+	unsigned int generation;
+
+	TablesJam() : subStyles(styleSubable, 0x80, 0x40, 0), generation(0) {
+	}
+};
+
+#ifdef LEXER_VERIFY
+#include "test/ReferenceJam.h"
+#endif
+
 class LexJam : public DefaultLexer {
-	WordList keywords;
 	OptionsJam options;
 	OptionSetJam osJam;
 	enum { ssIdentifier, ssVariable };
-	SubStyles subStyles;
+	TablesJam tables;
+	Published<TablesJam> published;
+	unsigned int lexedGeneration;
+	LexerStatus status;
+	LatencyStats latency;
+	StyleBuffer styleBuffer;
+	ResumeJam resume;
+	FoldIndex folds;
+	BraceIndex braces;
+	RunIndex styleRuns;
+	LexerStream stream;
+	TokenStream<ResumeJam> tokens;
+	WordMemo words;
+#ifdef LEXER_VERIFY
+	ReferenceJam reference;
+	DualRun dualRun;
+#endif
+	void Publish() {
+		tables.generation++;
+		published.Publish(new TablesJam(tables));
+	}
+	KeywordSet *KeywordList(int n) {
+		switch (n) {
+		case 0:
+			return &tables.keywords;
+		}
+		return 0;
+	}
+	LexerKeywordSet *KeywordsCall(int operation, LexerKeywordSet *query);
+	bool IsReduced(IDocument *pAccess) const {
+		return options.hugeThreshold > 0 && stream.Size(pAccess) >= options.hugeThreshold;
+	}
+	Sci_Position LimitWork(bool reduced, Sci_PositionU startPos, Sci_Position length, LexAccessor &styler) const;
+	void LexRange(Sci_PositionU startPos, Sci_Position lengthDoc, int initStyle, IDocument *pAccess);
+	void FoldRange(Sci_PositionU startPos, Sci_Position length, IDocument *pAccess);
 public:
 	explicit LexJam() :
 		DefaultLexer("jam", 10000, lexicalClasses, ELEMENTS(lexicalClasses)),
-		subStyles(styleSubable, 0x80, 0x40, 0) {
+		published(new TablesJam(tables)),
+		lexedGeneration(0),
+		status{LEXER_MODE_FULL, 0, 0, 0, 0},
+		resume{-1, SCE_JAM_DEFAULT, kwOther, SCE_JAM_DEFAULT} {
 	}
 	virtual ~LexJam() override {
 	}
@@ -140,33 +312,35 @@ public:
 	Sci_Position SCI_METHOD WordListSet(int n, const char *wl) override;
 	void SCI_METHOD Lex(Sci_PositionU startPos, Sci_Position lengthDoc, int initStyle, IDocument *pAccess) override;
 	void SCI_METHOD Fold(Sci_PositionU startPos, Sci_Position lengthDoc, int initStyle, IDocument *pAccess) override;
-	void * SCI_METHOD PrivateCall(int operation, void *pointer) override {
-		return 0;
-	}
+	void * SCI_METHOD PrivateCall(int operation, void *pointer) override;
 	int SCI_METHOD LineEndTypesSupported() override {
 		return SC_LINE_END_TYPE_DEFAULT;
 	}
 	int SCI_METHOD AllocateSubStyles(int styleBase, int numberStyles) override {
-		return subStyles.Allocate(styleBase, numberStyles);
+		const int start = tables.subStyles.Allocate(styleBase, numberStyles);
+		Publish();
+		return start;
 	}
 	int SCI_METHOD SubStylesStart(int styleBase) override {
-		return subStyles.Start(styleBase);
+		return tables.subStyles.Start(styleBase);
 	}
 	int SCI_METHOD SubStylesLength(int styleBase) override {
-		return subStyles.Length(styleBase);
+		return tables.subStyles.Length(styleBase);
 	}
 	int SCI_METHOD StyleFromSubStyle(int subStyle) override {
-		const int styleBase = subStyles.BaseStyle(subStyle);
+		const int styleBase = tables.subStyles.BaseStyle(subStyle);
 		return styleBase;
 	}
 	int SCI_METHOD PrimaryStyleFromStyle(int style) override {
 		return style;
 	}
 	void SCI_METHOD FreeSubStyles() override {
-		subStyles.Free();
+		tables.subStyles.Free();
+		Publish();
 	}
 	void SCI_METHOD SetIdentifiers(int style, const char *identifiers) override {
-		subStyles.SetIdentifiers(style, identifiers);
+		tables.subStyles.SetIdentifiers(style, identifiers);
+		Publish();
 	}
 	int SCI_METHOD DistanceToSecondaryStyles() override {
 		return 0;
@@ -182,40 +356,195 @@ public:
 
 Sci_Position SCI_METHOD LexJam::PropertySet(const char *key, const char *val) {
 	if (osJam.PropertySet(&options, key, val)) {
+		resume.position = -1;
+		tokens.Invalidate();
+#ifdef LEXER_VERIFY
+		reference.Invalidate();
+#endif
 		return 0;
 	}
 	return -1;
 }
 
-Sci_Position SCI_METHOD LexJam::WordListSet(int n, const char *wl) {
-	WordList *wordListN = 0;
-	switch (n) {
-	case 0:
-		wordListN = &keywords;
+void * SCI_METHOD LexJam::PrivateCall(int operation, void *pointer) {
+	switch (operation) {
+	case LEXER_CALL_STATUS:
+		return &status;
+	case LEXER_CALL_LATENCY:
+		return pointer ? latency.Fill(static_cast<LexerLatency *>(pointer)) : 0;
+	case LEXER_CALL_LATENCY_RESET:
+		latency.Reset();
+		break;
+	case LEXER_CALL_LATENCY_STOP:
+		latency.Stop();
+		break;
+	case LEXER_CALL_FOLD_AT:
+	case LEXER_CALL_FOLD_NEXT:
+	case LEXER_CALL_FOLD_PREVIOUS:
+	case LEXER_CALL_FOLD_GET:
+		return pointer ? folds.Query(operation, static_cast<LexerFoldQuery *>(pointer)) : 0;
+	case LEXER_CALL_BRACE_MATCH:
+	case LEXER_CALL_BRACE_ENCLOSING:
+		return pointer ? braces.Query(operation, static_cast<LexerBraceQuery *>(pointer)) : 0;
+	case LEXER_CALL_STREAM_BEGIN:
+		return stream.Begin(static_cast<LexerStreamSink *>(pointer));
+	case LEXER_CALL_STREAM_FEED:
+		pointer = stream.Feed(this, static_cast<LexerStreamChunk *>(pointer));
+		// streams are not indexed, that would take memory for all of them
+		folds.Clear();
+		braces.Clear();
+		styleRuns.Clear();
+		tokens.Invalidate();
+		return pointer;
+	case LEXER_CALL_STREAM_END:
+		stream.End(this);
+		folds.Clear();
+		braces.Clear();
+		styleRuns.Clear();
+		tokens.Invalidate();
 		break;
+	case LEXER_CALL_KEYWORDS_USE:
+	case LEXER_CALL_KEYWORDS_GET:
+		return pointer ? KeywordsCall(operation, static_cast<LexerKeywordSet *>(pointer)) : 0;
+	case LEXER_CALL_RUNS:
+		return pointer && options.tokenRuns ? styleRuns.Query(static_cast<LexerRunQuery *>(pointer)) : 0;
+#ifdef LEXER_VERIFY
+	case LEXER_CALL_VERIFY:
+		return pointer ? dualRun.Fill(static_cast<LexerVerify *>(pointer)) : 0;
+	case LEXER_CALL_VERIFY_RESET:
+		dualRun.Reset();
+		break;
+#endif
+	}
+	return 0;
+}
+
+// Shortens the range in reduced mode so that a single call does a bounded
+// amount of work, always ending on a line boundary.
+Sci_Position LexJam::LimitWork(bool reduced, Sci_PositionU startPos, Sci_Position length, LexAccessor &styler) const {
+	if (!reduced || options.hugeMaxWork <= 0
+		|| length <= options.hugeMaxWork)
+		return length;
+	const Sci_Position line = styler.GetLine(startPos + options.hugeMaxWork);
+	const Sci_Position end = styler.LineStart(line + 1);
+	return std::min<Sci_Position>(length, end - startPos);
+}
+
+LexerKeywordSet *LexJam::KeywordsCall(int operation, LexerKeywordSet *query) {
+	KeywordSet *wordListN = KeywordList(query->list);
+	if (!wordListN)
+		return 0;
+	if (operation == LEXER_CALL_KEYWORDS_GET) {
+		query->data = wordListN->Data();
+		query->size = wordListN->Size();
+		return query;
 	}
+	if (!wordListN->Attach(query->data, query->size, false))
+		return 0;
+	Publish();
+	return query;
+}
+
+Sci_Position SCI_METHOD LexJam::WordListSet(int n, const char *wl) {
+	KeywordSet *wordListN = KeywordList(n);
 	Sci_Position firstModification = -1;
-	if (wordListN) {
-		WordList wlNew;
-		wlNew.Set(wl);
-		if (*wordListN != wlNew) {
-			wordListN->Set(wl);
-			firstModification = 0;
-		}
+	if (wordListN && wordListN->Set(wl, false)) {
+		Publish();
+		firstModification = 0;
 	}
 	return firstModification;
 }
 
 void SCI_METHOD LexJam::Lex(Sci_PositionU startPos, Sci_Position lengthDoc, int initStyle, IDocument *pAccess) {
-	Accessor styler(pAccess, NULL);
-	StyleContext sc(startPos, lengthDoc, initStyle, styler);
+#ifdef LEXER_VERIFY
+	if (options.verify) {
+		const bool reduced = IsReduced(pAccess);
+		dualRun.Lex([&]() {
+			LexRange(startPos, lengthDoc, initStyle, pAccess);
+			return status.lexedTo;
+		}, [&](IDocument *recorded, Sci_Position end) {
+			const Published<TablesJam>::Reader snapshot(published);
+			reference.Lex(options, *snapshot, reduced, startPos, end - startPos, initStyle, recorded);
+		}, startPos, initStyle, pAccess);
+		dualRun.CompareBraces(braces, SCE_JAM_OPERATOR, pAccess, status.lexedTo);
+		if (options.tokenRuns) {
+			const Published<TablesJam>::Reader snapshot(published);
+			dualRun.CompareRuns(styleRuns, snapshot->subStyles, pAccess, status.lexedTo);
+		}
+		return;
+	}
+#endif
+	LexRange(startPos, lengthDoc, initStyle, pAccess);
+}
 
-	const WordClassifier &classifierIdentifiers = subStyles.Classifier(SCE_JAM_IDENTIFIER);
-	const WordClassifier &classifierVariables = subStyles.Classifier(SCE_JAM_VARIABLE);
+void SCI_METHOD LexJam::Fold(Sci_PositionU startPos, Sci_Position length, int, IDocument *pAccess) {
+#ifdef LEXER_VERIFY
+	if (options.verify && options.fold) {
+		const bool reduced = IsReduced(pAccess);
+		dualRun.Fold([&]() {
+			FoldRange(startPos, length, pAccess);
+			return status.foldedTo;
+		}, [&](IDocument *recorded, Sci_Position end) {
+			reference.Fold(options, reduced, startPos, end - startPos, recorded);
+		}, startPos, length, pAccess);
+		dualRun.CompareFolds(folds, pAccess, status.foldedTo);
+		return;
+	}
+#endif
+	FoldRange(startPos, length, pAccess);
+}
+
+void LexJam::LexRange(Sci_PositionU startPos, Sci_Position lengthDoc, int initStyle, IDocument *pAccess) {
+	LatencyTimer timer(latency, &LatencyStats::AddLex);
+	styleBuffer.Resize(options.styleBufferSize, lengthDoc);
+	BufferedDocument styled(pAccess, styleBuffer, options.tokenRuns ? &styleRuns : nullptr);
+	Accessor styler(&styled, NULL);
+	status.mode = IsReduced(pAccess) ? LEXER_MODE_REDUCED : LEXER_MODE_FULL;
+	const bool reduced = status.mode == LEXER_MODE_REDUCED;
+	lengthDoc = LimitWork(reduced, startPos, lengthDoc, styler);
+	const WorkBudget budget(startPos, options.budgetBytes, options.budgetMilliseconds);
+	ByteContext sc(startPos, lengthDoc, initStyle, styler);
+
+	// the tables stay as they are until the end, even if the host changes them
+	const Published<TablesJam>::Reader snapshot(published);
+	if (snapshot->generation != lexedGeneration) {
+		lexedGeneration = snapshot->generation;
+		resume.position = -1;
+		tokens.Invalidate();
+		words.Clear();
+	}
+	const KeywordSet &keywords = snapshot->keywords;
+	const WordClassifier &classifierIdentifiers = snapshot->subStyles.Classifier(SCE_JAM_IDENTIFIER);
+	const WordClassifier &classifierVariables = snapshot->subStyles.Classifier(SCE_JAM_VARIABLE);
 
 	kwType kwLast = kwOther;
 	int varLastStyle = SCE_JAM_DEFAULT;
+	if (resume.position == static_cast<Sci_Position>(startPos) && resume.style == initStyle) {
+		kwLast = resume.kwLast;
+		varLastStyle = resume.varLastStyle;
+	}
+	if (options.tokenStream)
+		tokens.Begin(pAccess, startPos, lengthDoc, { static_cast<Sci_Position>(startPos), sc.state, kwLast, varLastStyle });
+	braces.Truncate(startPos, styler.Length());
+	if (options.tokenRuns)
+		styleRuns.Truncate(startPos, snapshot->subStyles, options.tokenStream);
+	else
+		styleRuns.Clear();
+	bool reused = false;
+	const RunTable<SCE_JAM_VARIABLE + 1> &runs = options.tokenStream ? jamLineRuns : jamRuns;
 	for(; sc.More(); sc.Forward()) {
+		// only stop at line starts, identifiers never span lines
+		if (sc.atLineStart && budget.Exhausted(sc.currentPos))
+			break;
+		// the substyle of a variable depends on all of its text, which may
+		// have changed before the line start
+		if (sc.atLineStart && options.tokenStream && sc.state != SCE_JAM_VARIABLE
+			&& tokens.Line(sc.currentPos, { static_cast<Sci_Position>(sc.currentPos), sc.state, kwLast, varLastStyle })) {
+			reused = true;
+			break;
+		}
+		if (SkipRun(sc, runs.For(sc.state)) && !sc.More())
+			break;
 		switch(sc.state) {
 			case SCE_JAM_COMMENT: {
 				if (sc.ch == '\r' || sc.ch == '\n') {
@@ -238,11 +567,17 @@ void SCI_METHOD LexJam::Lex(Sci_PositionU startPos, Sci_Position lengthDoc, int
 			} break;
 			case SCE_JAM_VARIABLE: {
 				if(sc.ch == ')') {
-					char s[100];
-					sc.GetCurrent(s, sizeof(s));
-					int subStyle = classifierVariables.ValueFor(&s[2]); // skip $(
-					if (subStyle >= 0) {
-						sc.ChangeState(subStyle);
+					if (!reduced && classifierVariables.Length() > 0) {
+						char s[100];
+						sc.GetCurrent(s, sizeof(s));
+						// a call starting inside a variable which spans lines
+						// has only its tail, without the $(
+						if (strlen(s) >= 2) {
+							int subStyle = classifierVariables.ValueFor(&s[2]); // skip $(
+							if (subStyle >= 0) {
+								sc.ChangeState(subStyle);
+							}
+						}
 					}
 					sc.ForwardSetState(varLastStyle);
 					if(varLastStyle == SCE_JAM_STRING && sc.ch == '\"') {
@@ -260,19 +595,35 @@ void SCI_METHOD LexJam::Lex(Sci_PositionU startPos, Sci_Position lengthDoc, int
 					int style = SCE_JAM_IDENTIFIER;
 					if (kwLast == kwLocal || kwLast == kwFor) {
 						style = SCE_JAM_VARIABLE;
-						int subStyle = classifierVariables.ValueFor(s);
+						int subStyle = -1;
+						if (!reduced && classifierVariables.Length() > 0)
+							subStyle = classifierVariables.ValueFor(s);
 						if (subStyle >= 0) {
 							style = subStyle;
 						}
-					} else if (keywords.InList(s)) {
-						style = SCE_JAM_KEYWORD;
-					} else if (IsANumber(s)) {
-						style = SCE_JAM_NUMBER;
+					} else if (reduced) {
+						if (keywords.InList(s)) {
+							style = SCE_JAM_KEYWORD;
+						} else if (IsADigit(s[0])) {
+							// only look at the first character of huge documents
+							style = SCE_JAM_NUMBER;
+						}
 					} else {
-						int subStyle = classifierIdentifiers.ValueFor(s);
-						if (subStyle >= 0) {
-							style = subStyle;
+						const int known = words.Find(s);
+						if (known >= 0) {
+							style = known;
+						} else if (keywords.InList(s)) {
+							style = SCE_JAM_KEYWORD;
+						} else if (IsANumber(s)) {
+							style = SCE_JAM_NUMBER;
+						} else if (classifierIdentifiers.Length() > 0) {
+							int subStyle = classifierIdentifiers.ValueFor(s);
+							if (subStyle >= 0) {
+								style = subStyle;
+							}
 						}
+						if (known < 0)
+							words.Add(s, style);
 					}
 					sc.ChangeState(style);
 					sc.SetState(sc.ch == '$' ? SCE_JAM_VARIABLE : SCE_JAM_DEFAULT);
@@ -294,6 +645,7 @@ void SCI_METHOD LexJam::Lex(Sci_PositionU startPos, Sci_Position lengthDoc, int
 				sc.SetState(SCE_JAM_STRING);
 			} else if (IsASCII(sc.ch) && (isoperator(static_cast<char>(sc.ch)) || sc.ch == '@')) {
 				sc.SetState(SCE_JAM_OPERATOR);
+				braces.Add(sc.currentPos, sc.ch);
 			} else if(isalnum(sc.ch)) {
 				sc.SetState(SCE_JAM_IDENTIFIER);
 			} else if(sc.ch == '$') {
@@ -303,36 +655,71 @@ void SCI_METHOD LexJam::Lex(Sci_PositionU startPos, Sci_Position lengthDoc, int
 			}
 		}
 	}
+	const ResumeJam reached = { static_cast<Sci_Position>(sc.currentPos), sc.state, kwLast, varLastStyle };
+	status.stopped = sc.More() && !reused;
 	sc.Complete();
+	styled.Flush();
+	status.lexedTo = std::min<Sci_Position>(sc.currentPos, styler.Length());
+	status.styleFlushes = styleBuffer.Flushes();
+	resume = reached;
+	if (options.tokenStream) {
+		// the last line ends where the range does
+		if (!reused && !status.stopped && sc.state != SCE_JAM_VARIABLE
+			&& (sc.atLineStart || reached.position == styler.Length()))
+			reused = tokens.Line(sc.currentPos, reached);
+		if (reused) {
+			status.lexedTo = std::min<Sci_Position>(startPos + lengthDoc, styler.Length());
+			if (options.tokenRuns)
+				styleRuns.Restore(sc.currentPos - tokens.Delta(), tokens.Delta(), status.lexedTo, pAccess);
+			// the rest is styled already, only tell the document so
+			styled.StartStyling(status.lexedTo);
+		}
+		tokens.End();
+		if (reused) {
+			if (!tokens.StateAt(startPos + lengthDoc, resume))
+				resume = ResumeJam{ -1, SCE_JAM_DEFAULT, kwOther, SCE_JAM_DEFAULT };
+		}
+	}
+	// the brackets after the lexed text are still there, moved with it
+	braces.Restore(reached.position, status.lexedTo);
 }
 
-static bool IsCommentLine(Sci_Position line, LexAccessor &styler) {
-	Sci_Position pos = styler.LineStart(line);
-	Sci_Position eol_pos = styler.LineStart(line + 1) - 1;
-	for (Sci_Position i = pos; i < eol_pos; i++) {
-		char ch = styler[i];
-		if (ch == '#')
-			return true;
-		else if (ch != ' ' && ch != '\t')
-			return false;
-	}
-	return false;
+// Fold kind of the next brace after the word of style at pos: the body of
+// rule and actions definitions, otherwise whatever it was before.
+static int BraceKindAt(Sci_PositionU pos, int style, LexAccessor &styler, int kind) {
+	if (styler.Match(pos, "rule") && styler.StyleAt(pos + 4) != style)
+		return LEXER_FOLD_RULE;
+	if (styler.Match(pos, "actions") && styler.StyleAt(pos + 7) != style)
+		return LEXER_FOLD_ACTIONS;
+	return kind;
 }
 
 // Folding code from Bash lexer by Kein-Hong Man
-void SCI_METHOD LexJam::Fold(Sci_PositionU startPos, Sci_Position length, int, IDocument *pAccess) {
+void LexJam::FoldRange(Sci_PositionU startPos, Sci_Position length, IDocument *pAccess) {
 	if(!options.fold)
 		return;
 
+	LatencyTimer timer(latency, &LatencyStats::AddFold);
 	LexAccessor styler(pAccess);
 
+	const bool reduced = IsReduced(pAccess);
+	length = LimitWork(reduced, startPos, length, styler);
 	Sci_PositionU endPos = startPos + length;
+	// do not fold text the last Lex call did not get to
+	if (status.stopped && status.lexedTo > static_cast<Sci_Position>(startPos)
+		&& status.lexedTo < static_cast<Sci_Position>(endPos))
+		endPos = status.lexedTo;
 	int visibleChars = 0;
 	Sci_Position lineCurrent = styler.GetLine(startPos);
 	int levelPrev = styler.LevelAt(lineCurrent) & SC_FOLDLEVELNUMBERMASK;
 	int levelCurrent = levelPrev;
+	// kind of the first fold opened on the line, and of the next brace
+	int lineKind = LEXER_FOLD_ANY;
+	int braceKind = LEXER_FOLD_BLOCK;
+	folds.Truncate(lineCurrent);
 	char chNext = styler[startPos];
 	int styleNext = styler.StyleAt(startPos);
+	int stylePrev = startPos > 0 ? static_cast<int>(styler.StyleAt(startPos - 1)) : SCE_JAM_DEFAULT;
 	for (Sci_PositionU i = startPos; i < endPos; i++) {
 		char ch = chNext;
 		chNext = styler.SafeGetCharAt(i + 1);
@@ -340,21 +727,31 @@ void SCI_METHOD LexJam::Fold(Sci_PositionU startPos, Sci_Position length, int, I
 		styleNext = styler.StyleAt(i + 1);
 		bool atEOL = (ch == '\r' && chNext != '\n') || (ch == '\n');
 		// Comment folding
-		if (options.foldComment && atEOL && IsCommentLine(lineCurrent, styler))
+		if (options.foldComment && !reduced && atEOL && IsCommentLine(lineCurrent, styler))
 		{
 			if (!IsCommentLine(lineCurrent - 1, styler)
-				&& IsCommentLine(lineCurrent + 1, styler))
+				&& IsCommentLine(lineCurrent + 1, styler)) {
 				levelCurrent++;
-			else if (IsCommentLine(lineCurrent - 1, styler)
+				if (lineKind == LEXER_FOLD_ANY)
+					lineKind = LEXER_FOLD_COMMENT;
+			} else if (IsCommentLine(lineCurrent - 1, styler)
 					 && !IsCommentLine(lineCurrent + 1, styler))
 				levelCurrent--;
 		}
 
+		if (style != stylePrev && (style == SCE_JAM_KEYWORD || style == SCE_JAM_IDENTIFIER))
+			braceKind = BraceKindAt(i, style, styler, braceKind);
+
 		if (style == SCE_JAM_OPERATOR) {
 			if (ch == '{') {
 				levelCurrent++;
+				if (lineKind == LEXER_FOLD_ANY)
+					lineKind = braceKind;
+				braceKind = LEXER_FOLD_BLOCK;
 			} else if (ch == '}') {
 				levelCurrent--;
+			} else if (ch == ';') {
+				braceKind = LEXER_FOLD_BLOCK;
 			}
 		}
 
@@ -367,16 +764,22 @@ void SCI_METHOD LexJam::Fold(Sci_PositionU startPos, Sci_Position length, int, I
 			if (lev != styler.LevelAt(lineCurrent)) {
 				styler.SetLevel(lineCurrent, lev);
 			}
+			folds.Line(lineCurrent, lev & SC_FOLDLEVELNUMBERMASK, (lev & SC_FOLDLEVELHEADERFLAG) != 0,
+				lineKind == LEXER_FOLD_ANY ? LEXER_FOLD_BLOCK : lineKind);
 			lineCurrent++;
 			levelPrev = levelCurrent;
 			visibleChars = 0;
+			lineKind = LEXER_FOLD_ANY;
 		}
 		if (!isspacechar(ch))
 			visibleChars++;
+		stylePrev = style;
 	}
 	// Fill in the real level of the next line, keeping the current flags as they will be filled in later
 	int flagsNext = styler.LevelAt(lineCurrent) & ~SC_FOLDLEVELNUMBERMASK;
 	styler.SetLevel(lineCurrent, levelPrev | flagsNext);
+	folds.Line(lineCurrent, levelPrev & SC_FOLDLEVELNUMBERMASK, false, LEXER_FOLD_BLOCK);
+	status.foldedTo = endPos;
 }
 
 extern "C" {
@@ -24,6 +24,7 @@
 #include <assert.h>
 #include <ctype.h>
 
+#include <algorithm>
 #include <string>
 #include <map>
 #include <vector>
@@ -42,57 +43,137 @@
 #include "DefaultLexer.h"
 
 #include "common.h"
+#include "LatencyStats.h"
+#include "StyleBuffer.h"
+#include "WorkBudget.h"
+#include "RunSkip.h"
+#include "ByteContext.h"
+#include "FoldIndex.h"
+#include "LexerStream.h"
+#include "TokenStream.h"
+#include "WordMemo.h"
+#include "Published.h"
+#include "KeywordSet.h"
+#include "RunIndex.h"
+#ifdef LEXER_VERIFY
+#include "test/DualRun.h"
+#endif
 
 using namespace Scintilla;
 using namespace Lexilla;
 
-/* Bits:
- * 1  - whitespace
- * 2  - operator
- * 4  - identifier
- * 8  - decimal digit
- * 16 - hex digit
- * 32 - bin digit
- * 64 - letter
- */
-static int character_classification[128] =
-{
-		0,  0,  0,  0,  0,  0,  0,  0,  0,  1,  1,  0,  0,  1,  0,  0,
-		0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
-		1,  2,  0,  2,  68,  2,  2,  2,  2,  2,  2,  2,  2,  2,  10, 2,
-	 60, 60, 28, 28, 28, 28, 28, 28, 28, 28,  2,  2,  2,  2,  2,  2,
-		2, 84, 84, 84, 84, 84, 84, 68, 68, 68, 68, 68, 68, 68, 68, 68,
-	 68, 68, 68, 68, 68, 68, 68, 68, 68, 68, 68,  2,  2,  2,  2, 68,
-		2, 84, 84, 84, 84, 84, 84, 68, 68, 68, 68, 68, 68, 68, 68, 68,
-	 68, 68, 68, 68, 68, 68, 68, 68, 68, 68, 68,  2,  2,  2,  2,  0
+static constexpr CharClass yabSpace = CharClass::Of(" \t\n\r");
+static constexpr CharClass yabOperator = CharClass::Of("!#%&'()*+,-./:;<=>?@[\\]^`{|}~");
+static constexpr CharClass yabLetter = CharClass::Of("$_")
+	| CharClass::Range('A', 'Z') | CharClass::Range('a', 'z');
+static constexpr CharClass yabIdentifier = yabLetter | CharClass::Range('0', '9');
+static constexpr CharClass yabDigit = CharClass::Of(".") | CharClass::Range('0', '9');
+static constexpr CharClass yabHexDigit = CharClass::Range('0', '9')
+	| CharClass::Range('A', 'F') | CharClass::Range('a', 'f');
+static constexpr CharClass yabBinDigit = CharClass::Of("01");
+// Characters after which ByteContext::atLineEnd may be set
+static constexpr CharClass yabLineEnd = CharClass::Of("\r\n") | CharClass::Nul();
+
+// Runs never include white space so that skipping them only has to clear
+// isfirst, see LexYAB::Lex.
+static constexpr RunRule yabRunRules[] = {
+	{ SCE_B_IDENTIFIER, yabIdentifier },
+	{ SCE_B_OPERATOR, yabOperator - CharClass::Of("#") },
+	{ SCE_B_LABEL, yabIdentifier },
+	{ SCE_B_CONSTANT, yabIdentifier },
+	{ SCE_B_NUMBER, yabDigit },
+	{ SCE_B_HEXNUMBER, yabHexDigit },
+	{ SCE_B_BINNUMBER, yabBinDigit },
+	{ SCE_B_STRING, ~(CharClass::Of("\"") | yabLineEnd | yabSpace) },
+	{ SCE_B_COMMENT, ~(yabLineEnd | yabSpace) },
+	{ SCE_B_PREPROCESSOR, ~(yabLineEnd | yabSpace) },
+	{ SCE_B_DOCLINE, ~(CharClass::Of("\\@") | yabLineEnd | yabSpace) },
+	{ SCE_B_DOCKEYWORD, ~(yabLineEnd | yabSpace) },
+	{ SCE_B_COMMENTBLOCK, ~(CharClass::Of("'") | yabSpace) },
+	{ SCE_B_DOCBLOCK, ~(CharClass::Of("'\\@") | yabSpace) },
+};
+static constexpr RunTable<SCE_B_DOCKEYWORD + 1> yabRuns(yabRunRules);
+
+// What a character may start in SCE_B_DEFAULT. Characters which can begin
+// several tokens get their own entry and are resolved by looking ahead.
+enum TokenStart : unsigned char {
+	tsSpace,
+	tsError,
+	tsDot,			// label at line start, else number
+	tsComment,
+	tsSlash,		// //, /' or operator
+	tsR,			// rem or identifier
+	tsString,
+	tsNumber,
+	tsDollar,		// hexadecimal number or identifier
+	tsAmpersand,	// &h, &o, &b or operator
+	tsPercent,		// binary number or operator
+	tsHash,			// constant or operator
+	tsOperator,
+	tsIdentifier
+};
+
+struct TokenStartTable {
+	TokenStart starts[256];
+	constexpr TokenStartTable() : starts{} {
+		for (int c = 0; c < 256; c++) {
+			TokenStart start = tsError;
+			if (yabSpace.Contains(c))
+				start = tsSpace;
+			else if (c == '.')
+				start = tsDot;
+			else if (c == '/')
+				start = tsSlash;
+			else if (c == 'r')
+				start = tsR;
+			else if (c == '"')
+				start = tsString;
+			else if (yabDigit.Contains(c))
+				start = tsNumber;
+			else if (c == '$')
+				start = tsDollar;
+			else if (c == '&')
+				start = tsAmpersand;
+			else if (c == '%')
+				start = tsPercent;
+			else if (c == '#')
+				start = tsHash;
+			else if (yabOperator.Contains(c))
+				start = tsOperator;
+			else if (yabIdentifier.Contains(c))
+				start = tsIdentifier;
+			starts[c] = start;
+		}
+	}
 };
+static constexpr TokenStartTable yabTokenStarts;
 
 static bool IsSpace(int c) {
-	return c < 128 && (character_classification[c] & 1);
+	return yabSpace.Contains(c);
 }
 
 static bool IsOperator(int c) {
-	return c < 128 && (character_classification[c] & 2);
+	return yabOperator.Contains(c);
 }
 
 static bool IsIdentifier(int c) {
-	return c < 128 && (character_classification[c] & 4);
+	return yabIdentifier.Contains(c);
 }
 
 static bool IsDigit(int c) {
-	return c < 128 && (character_classification[c] & 8);
+	return yabDigit.Contains(c);
 }
 
 static bool IsHexDigit(int c) {
-	return c < 128 && (character_classification[c] & 16);
+	return yabHexDigit.Contains(c);
 }
 
 static bool IsBinDigit(int c) {
-	return c < 128 && (character_classification[c] & 32);
+	return yabBinDigit.Contains(c);
 }
 
 static bool IsLetter(int c) {
-	return c < 128 && (character_classification[c] & 64);
+	return yabLetter.Contains(c);
 }
 
 static int LowerCase(int c)
@@ -157,6 +238,18 @@ static int CheckFreeFoldPoint(char const *token, int &level) {
 	return 0;
 }
 
+// Kind of the fold opened by a word CheckFoldPoint accepted
+static int FoldKindOf(const char *word) {
+	static const char * const typeWords[] = {
+		"type", "structure", "enumeration", "interface", "enum", "union", 0
+	};
+	for (int i = 0; typeWords[i]; i++) {
+		if (!strcmp(word, typeWords[i]))
+			return LEXER_FOLD_TYPE;
+	}
+	return LEXER_FOLD_FUNCTION;
+}
+
 // An individual named option for use in an OptionSet
 
 // Options used for LexYAB
@@ -168,6 +261,16 @@ struct OptionsBasic {
 	std::string foldExplicitEnd;
 	bool foldExplicitAnywhere;
 	bool foldCompact;
+	int hugeThreshold;
+	int hugeMaxWork;
+	int styleBufferSize;
+	int budgetBytes;
+	int budgetMilliseconds;
+	bool tokenStream;
+	bool tokenRuns;
+#ifdef LEXER_VERIFY
+	bool verify;
+#endif
 	OptionsBasic() {
 		fold = false;
 		foldSyntaxBased = true;
@@ -176,6 +279,16 @@ struct OptionsBasic {
 		foldExplicitEnd   = "";
 		foldExplicitAnywhere = false;
 		foldCompact = true;
+		hugeThreshold = 16 * 1024 * 1024;
+		hugeMaxWork = 1024 * 1024;
+		styleBufferSize = 256 * 1024;
+		budgetBytes = 0;
+		budgetMilliseconds = 0;
+		tokenStream = false;
+		tokenRuns = false;
+#ifdef LEXER_VERIFY
+		verify = false;
+#endif
 	}
 };
 
@@ -226,29 +339,147 @@ struct OptionSetBasic : public OptionSet<OptionsBasic> {
 
 		DefineProperty("fold.compact", &OptionsBasic::foldCompact);
 
+		DefineProperty("lexer.yab.huge.threshold", &OptionsBasic::hugeThreshold,
+			"Documents of at least this many bytes are styled in reduced mode: "
+			"no substyles, no explicit fold points and only decimal numbers. "
+			"Set to 0 to always use full mode.");
+
+		DefineProperty("lexer.yab.huge.max.work", &OptionsBasic::hugeMaxWork,
+			"In reduced mode, the maximum number of bytes styled or folded by a single call. "
+			"The range is extended to the end of the line it ends in.");
+
+		DefineProperty("lexer.yab.style.buffer.size", &OptionsBasic::styleBufferSize,
+			"Largest number of styles collected before they are written to the document. The "
+			"buffer is only as large as the ranges lexed so far need. "
+			"Set to 0 to write them as soon as Scintilla's own small buffer fills up.");
+
+		DefineProperty("lexer.yab.budget.bytes", &OptionsBasic::budgetBytes,
+			"Stop lexing at the first line start after this many bytes. "
+			"The position reached is reported through PrivateCall and lexing can continue from there. "
+			"0 means no limit.");
+
+		DefineProperty("lexer.yab.budget.milliseconds", &OptionsBasic::budgetMilliseconds,
+			"Stop lexing at the first line start after this much time has passed. 0 means no limit.");
+
+		DefineProperty("lexer.yab.token.stream", &OptionsBasic::tokenStream,
+			"Remember the state at the end of every line, so that after an edit lexing stops "
+			"as soon as it gets to text which only moved. Takes memory for every line, and hashing "
+			"every line lexed makes styling long ranges slower, so it is off by default.");
+
+		DefineProperty("lexer.yab.token.runs", &OptionsBasic::tokenRuns,
+			"Record the runs of characters of the same style, which hosts can get through "
+			"PrivateCall instead of reading styles. Takes memory for every token.");
+
+#ifdef LEXER_VERIFY
+		DefineProperty("lexer.yab.verify", &OptionsBasic::verify,
+			"Lex and fold everything a second time with all fast paths turned off, and "
+			"compare the results. Differences and the time taken by both are reported "
+			"through PrivateCall. Only meant for testing.");
+#endif
+
 		DefineWordListSets(wordListDescriptions);
 	}
 };
 
-static const char* LexerName = "YAB";
-const char styleSubable[] = { SCE_B_IDENTIFIER, 0 };
+// Lexer state at the position where the last Lex call stopped. Restored
+// when the next call starts there, so lexing can be split across calls.
+struct ResumeBasic {
+	Sci_Position position;
+	int style;
+	bool wasfirst;
+	bool isfirst;
+	int styleBeforeKeyword;
+
+	bool Same(const ResumeBasic &other) const {
+		return style == other.style && wasfirst == other.wasfirst
+			&& isfirst == other.isfirst && styleBeforeKeyword == other.styleBeforeKeyword;
+	}
+};
+
+static const char LexerName[] = "YAB";
+static const char styleSubable[] = { SCE_B_IDENTIFIER, 0 };
+
+// Word lists and substyles as seen by Lex. The host changes its own copy,
+// Lex gets a new one published on every change, see Published.
+struct TablesBasic {
+	KeywordSet keywordlists[4];
+	SubStyles subStyles;
+	unsigned int generation;
+
+	TablesBasic() : subStyles(styleSubable, 0x80, 0x40, 0), generation(0) {
+	}
+};
+
+#ifdef LEXER_VERIFY
+#include "test/ReferenceBasic.h"
+#endif
 
 class LexYAB : public DefaultLexer {
 	char comment_char;
 	int (*CheckFoldPoint)(char const *, int &);
-	WordList keywordlists[4];
 	OptionsBasic options;
 	OptionSetBasic osBasic;
 	enum { ssIdentifier };
-	SubStyles subStyles;
+	TablesBasic tables;
+	Published<TablesBasic> published;
+	unsigned int lexedGeneration;
+	LexerStatus status;
+	LatencyStats latency;
+	StyleBuffer styleBuffer;
+	ResumeBasic resume;
+	TokenStart tokenStarts[256];
+	FoldIndex folds;
+	RunIndex styleRuns;
+	LexerStream stream;
+	TokenStream<ResumeBasic> tokens;
+	WordMemo words;
+#ifdef LEXER_VERIFY
+	ReferenceBasic reference;
+	DualRun dualRun;
+#endif
+	void Publish() {
+		tables.generation++;
+		published.Publish(new TablesBasic(tables));
+	}
+	KeywordSet *KeywordList(int n) {
+		switch (n) {
+		case 0:
+			return &tables.keywordlists[0];
+		case 1:
+			return &tables.keywordlists[1];
+		case 2:
+			return &tables.keywordlists[2];
+		case 3:
+			return &tables.keywordlists[3];
+		}
+		return 0;
+	}
+	LexerKeywordSet *KeywordsCall(int operation, LexerKeywordSet *query);
+	bool IsReduced(IDocument *pAccess) const {
+		return options.hugeThreshold > 0 && stream.Size(pAccess) >= options.hugeThreshold;
+	}
+	Sci_Position LimitWork(bool reduced, Sci_PositionU startPos, Sci_Position length, LexAccessor &styler) const;
+	void LexRange(Sci_PositionU startPos, Sci_Position length, int initStyle, IDocument *pAccess);
+	void FoldRange(Sci_PositionU startPos, Sci_Position length, IDocument *pAccess);
 public:
 	LexYAB(const char *languageName_, int language_, char comment_char_,
-		int (*CheckFoldPoint_)(char const *, int &), const char * const wordListDescriptions[]) :
+		int (*CheckFoldPoint_)(char const *, int &), const char * const wordListDescriptions_[]) :
 						DefaultLexer(languageName_, language_),
 						comment_char(comment_char_),
 						CheckFoldPoint(CheckFoldPoint_),
-						osBasic(wordListDescriptions),
-						subStyles(styleSubable, 0x80, 0x40, 0) {
+						osBasic(wordListDescriptions_),
+						published(new TablesBasic(tables)),
+						lexedGeneration(0),
+						status{LEXER_MODE_FULL, 0, 0, 0, 0},
+						resume{-1, SCE_B_DEFAULT, true, true, SCE_B_DEFAULT}
+#ifdef LEXER_VERIFY
+						, reference(comment_char_, CheckFoldPoint_)
+#endif
+						{
+		std::copy(std::begin(yabTokenStarts.starts), std::end(yabTokenStarts.starts), tokenStarts);
+		// comment character wins over everything but a label's dot
+		if (comment_char != '.')
+			tokenStarts[static_cast<unsigned char>(comment_char)] = tsComment;
 	}
 	virtual ~LexYAB() {
 	}
@@ -278,31 +509,33 @@ public:
 	void SCI_METHOD Lex(Sci_PositionU startPos, Sci_Position length, int initStyle, IDocument *pAccess) override;
 	void SCI_METHOD Fold(Sci_PositionU startPos, Sci_Position length, int initStyle, IDocument *pAccess) override;
 
-	void * SCI_METHOD PrivateCall(int, void *) override {
-		return 0;
-	}
+	void * SCI_METHOD PrivateCall(int operation, void *pointer) override;
 
 	int SCI_METHOD AllocateSubStyles(int styleBase, int numberStyles) override {
-		return subStyles.Allocate(styleBase, numberStyles);
+		const int start = tables.subStyles.Allocate(styleBase, numberStyles);
+		Publish();
+		return start;
 	}
 	int SCI_METHOD SubStylesStart(int styleBase) override {
-		return subStyles.Start(styleBase);
+		return tables.subStyles.Start(styleBase);
 	}
 	int SCI_METHOD SubStylesLength(int styleBase) override {
-		return subStyles.Length(styleBase);
+		return tables.subStyles.Length(styleBase);
 	}
 	int SCI_METHOD StyleFromSubStyle(int subStyle) override {
-		const int styleBase = subStyles.BaseStyle(subStyle);
+		const int styleBase = tables.subStyles.BaseStyle(subStyle);
 		return styleBase;
 	}
 	int SCI_METHOD PrimaryStyleFromStyle(int style) override {
 		return style;
 	}
 	void SCI_METHOD FreeSubStyles() override {
-		subStyles.Free();
+		tables.subStyles.Free();
+		Publish();
 	}
 	void SCI_METHOD SetIdentifiers(int style, const char *identifiers) override {
-		subStyles.SetIdentifiers(style, identifiers);
+		tables.subStyles.SetIdentifiers(style, identifiers);
+		Publish();
 	}
 	int SCI_METHOD DistanceToSecondaryStyles() override {
 		return 0;
@@ -318,52 +551,200 @@ public:
 
 Sci_Position SCI_METHOD LexYAB::PropertySet(const char *key, const char *val) {
 	if (osBasic.PropertySet(&options, key, val)) {
+		resume.position = -1;
+		tokens.Invalidate();
+#ifdef LEXER_VERIFY
+		reference.Invalidate();
+#endif
 		return 0;
 	}
 	return -1;
 }
 
-Sci_Position SCI_METHOD LexYAB::WordListSet(int n, const char *wl) {
-	WordList *wordListN = 0;
-	switch (n) {
-	case 0:
-		wordListN = &keywordlists[0];
+void * SCI_METHOD LexYAB::PrivateCall(int operation, void *pointer) {
+	switch (operation) {
+	case LEXER_CALL_STATUS:
+		return &status;
+	case LEXER_CALL_LATENCY:
+		return pointer ? latency.Fill(static_cast<LexerLatency *>(pointer)) : 0;
+	case LEXER_CALL_LATENCY_RESET:
+		latency.Reset();
 		break;
-	case 1:
-		wordListN = &keywordlists[1];
+	case LEXER_CALL_LATENCY_STOP:
+		latency.Stop();
 		break;
-	case 2:
-		wordListN = &keywordlists[2];
+	case LEXER_CALL_FOLD_AT:
+	case LEXER_CALL_FOLD_NEXT:
+	case LEXER_CALL_FOLD_PREVIOUS:
+	case LEXER_CALL_FOLD_GET:
+		return pointer ? folds.Query(operation, static_cast<LexerFoldQuery *>(pointer)) : 0;
+	case LEXER_CALL_STREAM_BEGIN:
+		return stream.Begin(static_cast<LexerStreamSink *>(pointer));
+	case LEXER_CALL_STREAM_FEED:
+		pointer = stream.Feed(this, static_cast<LexerStreamChunk *>(pointer));
+		// streams are not indexed, that would take memory for all of them
+		folds.Clear();
+		styleRuns.Clear();
+		tokens.Invalidate();
+		return pointer;
+	case LEXER_CALL_STREAM_END:
+		stream.End(this);
+		folds.Clear();
+		styleRuns.Clear();
+		tokens.Invalidate();
 		break;
-	case 3:
-		wordListN = &keywordlists[3];
+	case LEXER_CALL_KEYWORDS_USE:
+	case LEXER_CALL_KEYWORDS_GET:
+		return pointer ? KeywordsCall(operation, static_cast<LexerKeywordSet *>(pointer)) : 0;
+	case LEXER_CALL_RUNS:
+		return pointer && options.tokenRuns ? styleRuns.Query(static_cast<LexerRunQuery *>(pointer)) : 0;
+#ifdef LEXER_VERIFY
+	case LEXER_CALL_VERIFY:
+		return pointer ? dualRun.Fill(static_cast<LexerVerify *>(pointer)) : 0;
+	case LEXER_CALL_VERIFY_RESET:
+		dualRun.Reset();
 		break;
+#endif
+	}
+	return 0;
+}
+
+// Shortens the range in reduced mode so that a single call does a bounded
+// amount of work, always ending on a line boundary.
+Sci_Position LexYAB::LimitWork(bool reduced, Sci_PositionU startPos, Sci_Position length, LexAccessor &styler) const {
+	if (!reduced || options.hugeMaxWork <= 0 || length <= options.hugeMaxWork)
+		return length;
+	const Sci_Position line = styler.GetLine(startPos + options.hugeMaxWork);
+	const Sci_Position end = styler.LineStart(line + 1);
+	return std::min<Sci_Position>(length, end - startPos);
+}
+
+LexerKeywordSet *LexYAB::KeywordsCall(int operation, LexerKeywordSet *query) {
+	KeywordSet *wordListN = KeywordList(query->list);
+	if (!wordListN)
+		return 0;
+	if (operation == LEXER_CALL_KEYWORDS_GET) {
+		query->data = wordListN->Data();
+		query->size = wordListN->Size();
+		return query;
 	}
+	if (!wordListN->Attach(query->data, query->size, false))
+		return 0;
+	Publish();
+	return query;
+}
+
+Sci_Position SCI_METHOD LexYAB::WordListSet(int n, const char *wl) {
+	KeywordSet *wordListN = KeywordList(n);
 	Sci_Position firstModification = -1;
-	if (wordListN) {
-		WordList wlNew;
-		wlNew.Set(wl);
-		if (*wordListN != wlNew) {
-			wordListN->Set(wl);
-			firstModification = 0;
-		}
+	if (wordListN && wordListN->Set(wl, false)) {
+		Publish();
+		firstModification = 0;
 	}
 	return firstModification;
 }
 
 void SCI_METHOD LexYAB::Lex(Sci_PositionU startPos, Sci_Position length, int initStyle, IDocument *pAccess) {
-	LexAccessor styler(pAccess);
+#ifdef LEXER_VERIFY
+	if (options.verify) {
+		const bool reduced = IsReduced(pAccess);
+		dualRun.Lex([&]() {
+			LexRange(startPos, length, initStyle, pAccess);
+			return status.lexedTo;
+		}, [&](IDocument *recorded, Sci_Position end) {
+			const Published<TablesBasic>::Reader snapshot(published);
+			reference.Lex(*snapshot, reduced, startPos, end - startPos, initStyle, recorded);
+		}, startPos, initStyle, pAccess);
+		if (options.tokenRuns) {
+			const Published<TablesBasic>::Reader snapshot(published);
+			dualRun.CompareRuns(styleRuns, snapshot->subStyles, pAccess, status.lexedTo);
+		}
+		return;
+	}
+#endif
+	LexRange(startPos, length, initStyle, pAccess);
+}
+
+void SCI_METHOD LexYAB::Fold(Sci_PositionU startPos, Sci_Position length, int, IDocument *pAccess) {
+#ifdef LEXER_VERIFY
+	if (options.verify && options.fold) {
+		const bool reduced = IsReduced(pAccess);
+		dualRun.Fold([&]() {
+			FoldRange(startPos, length, pAccess);
+			return status.foldedTo;
+		}, [&](IDocument *recorded, Sci_Position end) {
+			reference.Fold(options, reduced, startPos, end - startPos, recorded);
+		}, startPos, length, pAccess);
+		dualRun.CompareFolds(folds, pAccess, status.foldedTo);
+		return;
+	}
+#endif
+	FoldRange(startPos, length, pAccess);
+}
+
+void LexYAB::LexRange(Sci_PositionU startPos, Sci_Position length, int initStyle, IDocument *pAccess) {
+	LatencyTimer timer(latency, &LatencyStats::AddLex);
+	styleBuffer.Resize(options.styleBufferSize, length);
+	BufferedDocument styled(pAccess, styleBuffer, options.tokenRuns ? &styleRuns : nullptr);
+	LexAccessor styler(&styled);
+
+	status.mode = IsReduced(pAccess) ? LEXER_MODE_REDUCED : LEXER_MODE_FULL;
+	const bool reduced = status.mode == LEXER_MODE_REDUCED;
+	length = LimitWork(reduced, startPos, length, styler);
+	const WorkBudget budget(startPos, options.budgetBytes, options.budgetMilliseconds);
+	bool stopped = false;
+
+	// the tables stay as they are until the end, even if the host changes them
+	const Published<TablesBasic>::Reader snapshot(published);
+	if (snapshot->generation != lexedGeneration) {
+		lexedGeneration = snapshot->generation;
+		resume.position = -1;
+		tokens.Invalidate();
+		words.Clear();
+	}
+	const KeywordSet *keywordlists = snapshot->keywordlists;
 
 	bool wasfirst = true, isfirst = true; // true if first token in a line
 	styler.StartAt(startPos);
 	int styleBeforeKeyword = SCE_B_DEFAULT;
+	if (resume.position == static_cast<Sci_Position>(startPos) && resume.style == initStyle) {
+		wasfirst = resume.wasfirst;
+		isfirst = resume.isfirst;
+		styleBeforeKeyword = resume.styleBeforeKeyword;
+	}
+	resume.position = -1;
 
-	const WordClassifier &classifierIdentifiers = subStyles.Classifier(SCE_B_IDENTIFIER);
+	const WordClassifier &classifierIdentifiers = snapshot->subStyles.Classifier(SCE_B_IDENTIFIER);
 
-	StyleContext sc(startPos, length, initStyle, styler);
+	ByteContext sc(startPos, length, initStyle, styler);
+	if (options.tokenStream)
+		tokens.Begin(pAccess, startPos, length, { static_cast<Sci_Position>(startPos), sc.state, wasfirst, isfirst, styleBeforeKeyword });
+	if (options.tokenRuns)
+		styleRuns.Truncate(startPos, snapshot->subStyles, options.tokenStream);
+	else
+		styleRuns.Clear();
+	bool reused = false;
 
 	// Can't use sc.More() here else we miss the last character
 	for (; ; sc.Forward()) {
+		// only stop at line starts, no token but block comments spans lines
+		if (sc.atLineStart && sc.More() && budget.Exhausted(sc.currentPos)) {
+			stopped = true;
+			break;
+		}
+		if ((sc.atLineStart || static_cast<Sci_Position>(sc.currentPos) == styler.Length()) && options.tokenStream
+			&& tokens.Line(sc.currentPos, { static_cast<Sci_Position>(sc.currentPos), sc.state, wasfirst, isfirst, styleBeforeKeyword })) {
+			reused = true;
+			break;
+		}
+		// The character at the end of the range is looked at too, so keep
+		// the state from before that for the next call starting there. If
+		// a token took the loop past the end there is nothing to keep.
+		if (!sc.More())
+			resume = { static_cast<Sci_Position>(sc.currentPos), sc.state, wasfirst, isfirst, styleBeforeKeyword };
+		// a skipped run is never white space, so it ends the line's first token
+		if (SkipRun(sc, yabRuns.For(sc.state)))
+			isfirst = false;
 		if (sc.state == SCE_B_IDENTIFIER) {
 			if (!IsIdentifier(sc.ch)) {
 				// Labels
@@ -379,14 +760,23 @@ void SCI_METHOD LexYAB::Lex(Sci_PositionU startPos, Sci_Position length, int ini
 						SCE_B_KEYWORD4,
 					};
 					sc.GetCurrentLowered(s, sizeof(s));
-					int subStyle = classifierIdentifiers.ValueFor(s);
-					if (subStyle >= 0) {
-						sc.ChangeState(subStyle);
-					}
-					for (int i = 0; i < 4; i++) {
-						if (keywordlists[i].InList(s)) {
-							sc.ChangeState(kstates[i]);
+					const int known = reduced ? -1 : words.Find(s);
+					if (known >= 0) {
+						sc.ChangeState(known);
+					} else {
+						if (!reduced && classifierIdentifiers.Length() > 0) {
+							int subStyle = classifierIdentifiers.ValueFor(s);
+							if (subStyle >= 0) {
+								sc.ChangeState(subStyle);
+							}
 						}
+						for (int i = 0; i < 4; i++) {
+							if (keywordlists[i].InList(s)) {
+								sc.ChangeState(kstates[i]);
+							}
+						}
+						if (!reduced)
+							words.Add(s, sc.state);
 					}
 					// Types, must set them as operator else they will be
 					// matched as number/constant
@@ -406,14 +796,11 @@ void SCI_METHOD LexYAB::Lex(Sci_PositionU startPos, Sci_Position length, int ini
 		} else if (sc.state == SCE_B_CONSTANT) {
 			if (!IsIdentifier(sc.ch))
 				sc.SetState(SCE_B_DEFAULT);
-		} else if (sc.state == SCE_B_NUMBER) {
-			if (!IsDigit(sc.ch))
-				sc.SetState(SCE_B_DEFAULT);
-		} else if (sc.state == SCE_B_HEXNUMBER) {
-			if (!IsHexDigit(sc.ch))
-				sc.SetState(SCE_B_DEFAULT);
-		} else if (sc.state == SCE_B_BINNUMBER) {
-			if (!IsBinDigit(sc.ch))
+		} else if (sc.state == SCE_B_NUMBER || sc.state == SCE_B_HEXNUMBER
+				|| sc.state == SCE_B_BINNUMBER) {
+			// SkipRun has consumed the digits, so this is the first character
+			// after the literal unless the range ended inside it
+			if (!yabRuns.For(sc.state).Contains(sc.ch))
 				sc.SetState(SCE_B_DEFAULT);
 		} else if (sc.state == SCE_B_STRING) {
 			if (sc.ch == '"') {
@@ -463,34 +850,84 @@ void SCI_METHOD LexYAB::Lex(Sci_PositionU startPos, Sci_Position length, int ini
 			isfirst = true;
 
 		if (sc.state == SCE_B_DEFAULT || sc.state == SCE_B_ERROR) {
-			if (isfirst && sc.Match('.') && comment_char != '\'') {
-				sc.SetState(SCE_B_LABEL);
-			} else if (sc.Match(comment_char) || sc.Match("//") || sc.Match("rem")) {
+			switch (sc.ch < 256 ? tokenStarts[sc.ch] : tsError) {
+			case tsSpace:
+				break;
+			case tsError:
+				sc.SetState(SCE_B_ERROR);
+				break;
+			case tsDot:
+				if (isfirst && comment_char != '\'') {
+					sc.SetState(SCE_B_LABEL);
+				} else if (sc.Match(comment_char)) {
+					sc.SetState(SCE_B_COMMENT);
+				} else {
+					sc.SetState(SCE_B_NUMBER);
+				}
+				break;
+			case tsComment:
 				sc.SetState(SCE_B_COMMENT);
-			} else if (sc.Match("/\'")) {
-				if (sc.Match("/\'*") || sc.Match("/\'!")) {	// Support of gtk-doc/Doxygen doc. style
-					sc.SetState(SCE_B_DOCBLOCK);
+				break;
+			case tsSlash:
+				if (sc.chNext == '/') {
+					sc.SetState(SCE_B_COMMENT);
+				} else if (sc.chNext == '\'') {
+					if (sc.Match("/\'*") || sc.Match("/\'!")) {	// Support of gtk-doc/Doxygen doc. style
+						sc.SetState(SCE_B_DOCBLOCK);
+					} else {
+						sc.SetState(SCE_B_COMMENTBLOCK);
+					}
+					sc.Forward();	// Eat the ' so it isn't used for the end of the comment
 				} else {
-					sc.SetState(SCE_B_COMMENTBLOCK);
+					sc.SetState(SCE_B_OPERATOR);
 				}
-				sc.Forward();	// Eat the ' so it isn't used for the end of the comment
-			} else if (sc.Match('"')) {
+				break;
+			case tsR:
+				if (sc.Match("rem")) {
+					sc.SetState(SCE_B_COMMENT);
+				} else {
+					wasfirst = isfirst;
+					sc.SetState(SCE_B_IDENTIFIER);
+				}
+				break;
+			case tsString:
 				sc.SetState(SCE_B_STRING);
-			} else if (IsDigit(sc.ch)) {
+				break;
+			case tsNumber:
 				sc.SetState(SCE_B_NUMBER);
-			} else if (sc.Match('$') || sc.Match("&h") || sc.Match("&H") || sc.Match("&o") || sc.Match("&O")) {
-				sc.SetState(SCE_B_HEXNUMBER);
-			} else if (sc.Match('%') || sc.Match("&b") || sc.Match("&B")) {
-				sc.SetState(SCE_B_BINNUMBER);
-			} else if (sc.Match('#')) {
-				sc.SetState(SCE_B_CONSTANT);
-			} else if (IsOperator(sc.ch)) {
+				break;
+			// no hexadecimal, binary or constant prefixes in huge documents
+			case tsDollar:
+				if (reduced) {
+					wasfirst = isfirst;
+					sc.SetState(SCE_B_IDENTIFIER);
+				} else {
+					sc.SetState(SCE_B_HEXNUMBER);
+				}
+				break;
+			case tsAmpersand:
+				if (!reduced && (sc.chNext == 'h' || sc.chNext == 'H'
+						|| sc.chNext == 'o' || sc.chNext == 'O')) {
+					sc.SetState(SCE_B_HEXNUMBER);
+				} else if (!reduced && (sc.chNext == 'b' || sc.chNext == 'B')) {
+					sc.SetState(SCE_B_BINNUMBER);
+				} else {
+					sc.SetState(SCE_B_OPERATOR);
+				}
+				break;
+			case tsPercent:
+				sc.SetState(reduced ? SCE_B_OPERATOR : SCE_B_BINNUMBER);
+				break;
+			case tsHash:
+				sc.SetState(reduced ? SCE_B_OPERATOR : SCE_B_CONSTANT);
+				break;
+			case tsOperator:
 				sc.SetState(SCE_B_OPERATOR);
-			} else if (IsIdentifier(sc.ch)) {
+				break;
+			case tsIdentifier:
 				wasfirst = isfirst;
 				sc.SetState(SCE_B_IDENTIFIER);
-			} else if (!IsSpace(sc.ch)) {
-				sc.SetState(SCE_B_ERROR);
+				break;
 			}
 		}
 
@@ -501,20 +938,48 @@ void SCI_METHOD LexYAB::Lex(Sci_PositionU startPos, Sci_Position length, int ini
 			break;
 	}
 	sc.Complete();
+	styled.Flush();
+	status.stopped = stopped;
+	status.lexedTo = std::min<Sci_Position>(sc.currentPos, styler.Length());
+	status.styleFlushes = styleBuffer.Flushes();
+	if (stopped)
+		resume = { static_cast<Sci_Position>(sc.currentPos), sc.state, wasfirst, isfirst, styleBeforeKeyword };
+	if (options.tokenStream) {
+		if (reused) {
+			status.lexedTo = std::min<Sci_Position>(startPos + length, styler.Length());
+			if (options.tokenRuns)
+				styleRuns.Restore(sc.currentPos - tokens.Delta(), tokens.Delta(), status.lexedTo, pAccess);
+			// the rest is styled already, only tell the document so
+			styled.StartStyling(status.lexedTo);
+		}
+		tokens.End();
+		if (reused) {
+			if (!tokens.StateAt(startPos + length, resume))
+				resume = ResumeBasic{ -1, SCE_B_DEFAULT, true, true, SCE_B_DEFAULT };
+		}
+	}
 }
 
 
-void SCI_METHOD LexYAB::Fold(Sci_PositionU startPos, Sci_Position length, int /* initStyle */, IDocument *pAccess) {
+void LexYAB::FoldRange(Sci_PositionU startPos, Sci_Position length, IDocument *pAccess) {
 
 	if (!options.fold)
 		return;
 
+	LatencyTimer timer(latency, &LatencyStats::AddFold);
 	LexAccessor styler(pAccess);
 
+	const bool reduced = IsReduced(pAccess);
+	length = LimitWork(reduced, startPos, length, styler);
 	Sci_Position line = styler.GetLine(startPos);
 	int level = styler.LevelAt(line);
 	int go = 0, done = 0;
+	int kind = LEXER_FOLD_FUNCTION;
+	folds.Truncate(line);
 	Sci_Position endPos = startPos + length;
+	// do not fold text the last Lex call did not get to
+	if (status.stopped && status.lexedTo > static_cast<Sci_Position>(startPos) && status.lexedTo < endPos)
+		endPos = status.lexedTo;
 	char word[256];
 	int wordlen = 0;
 	const bool userDefinedFoldMarkers = !options.foldExplicitStart.empty() && !options.foldExplicitEnd.empty();
@@ -532,6 +997,8 @@ void SCI_METHOD LexYAB::Fold(Sci_PositionU startPos, Sci_Position length, int /*
 				if (!IsIdentifier(c)) { // done with token
 					word[wordlen] = '\0';
 					go = CheckFoldPoint(word, level);
+					if (go > 0)
+						kind = FoldKindOf(word);
 					if (!go) {
 						// Treat any whitespace as single blank, for
 						// things like "End   Function".
@@ -556,11 +1023,12 @@ void SCI_METHOD LexYAB::Fold(Sci_PositionU startPos, Sci_Position length, int /*
 				}
 			}
 		}
-		if (options.foldCommentExplicit && ((styler.StyleAt(i) == SCE_B_COMMENT) || options.foldExplicitAnywhere)) {
+		if (options.foldCommentExplicit && !reduced && ((styler.StyleAt(i) == SCE_B_COMMENT) || options.foldExplicitAnywhere)) {
 			if (userDefinedFoldMarkers) {
 				if (styler.Match(i, options.foldExplicitStart.c_str())) {
  					level |= SC_FOLDLEVELHEADERFLAG;
 					go = 1;
+					kind = LEXER_FOLD_EXPLICIT;
 				} else if (styler.Match(i, options.foldExplicitEnd.c_str())) {
  					go = -1;
  				}
@@ -569,6 +1037,7 @@ void SCI_METHOD LexYAB::Fold(Sci_PositionU startPos, Sci_Position length, int /*
 					if (cNext == '{') {
 						level |= SC_FOLDLEVELHEADERFLAG;
 						go = 1;
+						kind = LEXER_FOLD_EXPLICIT;
 					} else if (cNext == '}') {
 						go = -1;
 					}
@@ -580,6 +1049,8 @@ void SCI_METHOD LexYAB::Fold(Sci_PositionU startPos, Sci_Position length, int /*
 				level |= SC_FOLDLEVELWHITEFLAG;
 			if (level != styler.LevelAt(line))
 				styler.SetLevel(line, level);
+			folds.Line(line, level & SC_FOLDLEVELNUMBERMASK,
+				(level & SC_FOLDLEVELHEADERFLAG) != 0, kind);
 			level += go;
 			line++;
 			// reset state
@@ -590,6 +1061,8 @@ void SCI_METHOD LexYAB::Fold(Sci_PositionU startPos, Sci_Position length, int /*
 			done = 0;
 		}
 	}
+	folds.Line(line, level & SC_FOLDLEVELNUMBERMASK, false, kind);
+	status.foldedTo = endPos;
 }
 
 extern "C" {
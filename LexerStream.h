@@ -0,0 +1,347 @@
+/*
+ * Copyright 2018-2019 Kacper Kasper <kacperkasper@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+#ifndef LEXERSTREAM_H
+#define LEXERSTREAM_H
+
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <ILexer.h>
+#include <Scintilla.h>
+
+#include "common.h"
+
+// IDocument over a window of a stream. Positions and lines are counted
+// from the start of the stream, the window starts at a line start and
+// ends with the text fed so far. Outside of it text reads as NUL, styles
+// as 0 and levels as SC_FOLDLEVELBASE.
+class StreamDocument : public Scintilla::IDocument {
+	Sci_Position base;		// stream position of text[0]
+	Sci_Position lineBase;	// stream line of lineStarts[0]
+	std::string text;
+	std::vector<char> styles;
+	std::vector<Sci_Position> lineStarts;
+	std::vector<int> levels;
+	Sci_Position styling;
+	int codePage;
+
+	bool Contains(Sci_Position position) const {
+		return position >= base && position < Length();
+	}
+	bool ContainsLine(Sci_Position line) const {
+		return line >= lineBase && line - lineBase < static_cast<Sci_Position>(lineStarts.size());
+	}
+public:
+	StreamDocument() : base(0), lineBase(0), styling(0), codePage(0) {
+		Reset(0);
+	}
+	void Reset(int codePage_) {
+		base = 0;
+		lineBase = 0;
+		text.clear();
+		styles.clear();
+		lineStarts.assign(1, 0);
+		levels.assign(1, SC_FOLDLEVELBASE);
+		styling = 0;
+		codePage = codePage_;
+	}
+	void Append(const char *s, Sci_Position length) {
+		const Sci_Position end = Length();
+		text.append(s, length);
+		styles.resize(text.size(), 0);
+		for (Sci_Position i = 0; i < length; i++) {
+			if (s[i] == '\n' && lineStarts.back() == end + i
+				&& Contains(end + i - 1) && text[end + i - 1 - base] == '\r') {
+				// second half of a CR LF
+				lineStarts.back()++;
+			} else if (s[i] == '\n' || s[i] == '\r') {
+				lineStarts.push_back(end + i + 1);
+				levels.push_back(SC_FOLDLEVELBASE);
+			}
+		}
+	}
+	// Forgets everything before the start of line.
+	void Discard(Sci_Position line) {
+		if (line <= lineBase || !ContainsLine(line))
+			return;
+		const Sci_Position lines = line - lineBase;
+		const Sci_Position start = lineStarts[lines];
+		text.erase(0, start - base);
+		styles.erase(styles.begin(), styles.begin() + (start - base));
+		lineStarts.erase(lineStarts.begin(), lineStarts.begin() + lines);
+		levels.erase(levels.begin(), levels.begin() + lines);
+		base = start;
+		lineBase = line;
+	}
+
+	int SCI_METHOD Version() const override {
+		return Scintilla::dvRelease4;
+	}
+	void SCI_METHOD SetErrorStatus(int) override {
+	}
+	Sci_Position SCI_METHOD Length() const override {
+		return base + static_cast<Sci_Position>(text.size());
+	}
+	void SCI_METHOD GetCharRange(char *buffer, Sci_Position position, Sci_Position lengthRetrieve) const override {
+		for (Sci_Position i = 0; i < lengthRetrieve; i++)
+			buffer[i] = Contains(position + i) ? text[position + i - base] : '\0';
+	}
+	char SCI_METHOD StyleAt(Sci_Position position) const override {
+		return Contains(position) ? styles[position - base] : 0;
+	}
+	Sci_Position SCI_METHOD LineFromPosition(Sci_Position position) const override {
+		const auto after = std::upper_bound(lineStarts.begin(), lineStarts.end(), position);
+		if (after == lineStarts.begin())
+			return lineBase;
+		return lineBase + (after - lineStarts.begin()) - 1;
+	}
+	Sci_Position SCI_METHOD LineStart(Sci_Position line) const override {
+		if (line < lineBase)
+			return base;
+		if (!ContainsLine(line))
+			return Length();
+		return lineStarts[line - lineBase];
+	}
+	int SCI_METHOD GetLevel(Sci_Position line) const override {
+		return ContainsLine(line) ? levels[line - lineBase] : SC_FOLDLEVELBASE;
+	}
+	int SCI_METHOD SetLevel(Sci_Position line, int level) override {
+		if (!ContainsLine(line))
+			return SC_FOLDLEVELBASE;
+		const int previous = levels[line - lineBase];
+		levels[line - lineBase] = level;
+		return previous;
+	}
+	int SCI_METHOD GetLineState(Sci_Position) const override {
+		return 0;
+	}
+	int SCI_METHOD SetLineState(Sci_Position, int) override {
+		return 0;
+	}
+	void SCI_METHOD StartStyling(Sci_Position position) override {
+		styling = position;
+	}
+	bool SCI_METHOD SetStyleFor(Sci_Position length, char style) override {
+		for (Sci_Position i = 0; i < length; i++, styling++) {
+			if (Contains(styling))
+				styles[styling - base] = style;
+		}
+		return true;
+	}
+	bool SCI_METHOD SetStyles(Sci_Position length, const char *s) override {
+		for (Sci_Position i = 0; i < length; i++, styling++) {
+			if (Contains(styling))
+				styles[styling - base] = s[i];
+		}
+		return true;
+	}
+	void SCI_METHOD DecorationSetCurrentIndicator(int) override {
+	}
+	void SCI_METHOD DecorationFillRange(Sci_Position, int, Sci_Position) override {
+	}
+	void SCI_METHOD ChangeLexerState(Sci_Position, Sci_Position) override {
+	}
+	int SCI_METHOD CodePage() const override {
+		return codePage;
+	}
+	bool SCI_METHOD IsDBCSLeadByte(char) const override {
+		return false;
+	}
+	const char * SCI_METHOD BufferPointer() override {
+		return 0;
+	}
+	int SCI_METHOD GetLineIndentation(Sci_Position) override {
+		return 0;
+	}
+	Sci_Position SCI_METHOD LineEnd(Sci_Position line) const override {
+		Sci_Position end = LineStart(line + 1);
+		if (!ContainsLine(line + 1))
+			return end;
+		if (Contains(end - 1) && text[end - 1 - base] == '\n')
+			end--;
+		if (Contains(end - 1) && text[end - 1 - base] == '\r')
+			end--;
+		return end;
+	}
+	Sci_Position SCI_METHOD GetRelativePosition(Sci_Position positionStart, Sci_Position characterOffset) const override {
+		Sci_Position position = positionStart;
+		for (; characterOffset > 0 && position < Length(); characterOffset--) {
+			Sci_Position width = 1;
+			GetCharacterAndWidth(position, &width);
+			position += width;
+		}
+		for (; characterOffset < 0 && position > base; characterOffset++) {
+			position--;
+			while (codePage == SC_CP_UTF8 && position > base
+				&& (static_cast<unsigned char>(text[position - base]) & 0xC0) == 0x80)
+				position--;
+		}
+		return characterOffset == 0 ? position : -1;
+	}
+	// Same results as Scintilla's Document for UTF-8 and single byte text
+	int SCI_METHOD GetCharacterAndWidth(Sci_Position position, Sci_Position *pWidth) const override {
+		int width = 1;
+		int character = Contains(position) ? static_cast<unsigned char>(text[position - base]) : 0;
+		if (codePage == SC_CP_UTF8 && character >= 0x80) {
+			const int lead = character;
+			int trail = 0;
+			if (lead >= 0xC2 && lead < 0xE0) {
+				trail = 1;
+				character = lead & 0x1F;
+			} else if (lead >= 0xE0 && lead < 0xF0) {
+				trail = 2;
+				character = lead & 0x0F;
+			} else if (lead >= 0xF0 && lead < 0xF5) {
+				trail = 3;
+				character = lead & 0x07;
+			}
+			bool valid = trail > 0 && Contains(position + trail);
+			for (int i = 1; valid && i <= trail; i++) {
+				const unsigned char byte = text[position + i - base];
+				valid = (byte & 0xC0) == 0x80;
+				character = (character << 6) | (byte & 0x3F);
+			}
+			if (valid) {
+				width = trail + 1;
+			} else {
+				// invalid bytes read as lone surrogates, like Scintilla
+				character = 0xDC80 + lead;
+			}
+		}
+		if (pWidth)
+			*pWidth = width;
+		return character;
+	}
+};
+
+// Styles and folds a stream chunk by chunk with a lexer of this package,
+// sending finished styles and levels to a LexerStreamSink.
+//
+// Only complete lines are lexed: the last line of the text fed so far is
+// kept until the next chunk ends it, and folding stays one more line
+// behind as Fold looks at the next line. Each Fold call starts one line
+// before the previous one stopped so the lexer picks up the level it
+// reached. The lexers resume their own state when a Lex call starts where
+// the previous one stopped, so the result is the same as lexing the whole
+// text at once. Memory use depends on the chunk and line lengths only.
+//
+// Length() is the text fed so far, so the lexers compare the huge document
+// threshold to Size() instead, which stays the same for the whole stream.
+class LexerStream {
+	StreamDocument document;
+	LexerStreamSink sink;
+	bool active;
+	Sci_Position size;			// the sink's, or the first chunk's length
+	Sci_Position lexedTo;
+	Sci_Position foldedLine;	// first line whose level was not sent yet
+	// style run not sent yet as the next one may continue it
+	Sci_Position runStart;
+	Sci_Position runLength;
+	int runStyle;
+
+	void SendStyles(Sci_Position start, Sci_Position end) {
+		for (Sci_Position i = start; i < end; i++) {
+			const int style = static_cast<unsigned char>(document.StyleAt(i));
+			if (runLength > 0 && style == runStyle) {
+				runLength++;
+				continue;
+			}
+			if (runLength > 0)
+				sink.styles(sink.cookie, runStart, runLength, runStyle);
+			runStart = i;
+			runLength = 1;
+			runStyle = style;
+		}
+	}
+	void Process(Scintilla::ILexer5 *lexer, bool last) {
+		// lex complete lines only, unless there is no more text
+		const Sci_Position length = document.Length();
+		Sci_Position end = length;
+		if (!last)
+			end = length > 0 ? document.LineStart(document.LineFromPosition(length - 1)) : 0;
+		while (lexedTo < end) {
+			const int initStyle = lexedTo > 0
+				? static_cast<unsigned char>(document.StyleAt(lexedTo - 1)) : 0;
+			lexer->Lex(lexedTo, end - lexedTo, initStyle, &document);
+			const LexerStatus *status = static_cast<const LexerStatus *>(
+				lexer->PrivateCall(LEXER_CALL_STATUS, 0));
+			const Sci_Position reached = status ? status->lexedTo : end;
+			if (reached <= lexedTo)
+				break;
+			SendStyles(lexedTo, reached);
+			lexedTo = reached;
+		}
+		if (last && runLength > 0) {
+			sink.styles(sink.cookie, runStart, runLength, runStyle);
+			runLength = 0;
+		}
+
+		if (sink.level) {
+			// Fold reads the line after the last one it folds
+			Sci_Position lastLine = document.LineFromPosition(lexedTo);
+			if (!last)
+				lastLine--;
+			if (lastLine > foldedLine || (last && lastLine >= foldedLine)) {
+				const Sci_Position start = document.LineStart(std::max<Sci_Position>(foldedLine - 1, 0));
+				const Sci_Position foldEnd = last ? lexedTo : document.LineStart(lastLine);
+				lexer->Fold(start, foldEnd - start,
+					start > 0 ? static_cast<unsigned char>(document.StyleAt(start - 1)) : 0, &document);
+				if (last)
+					lastLine++;
+				for (; foldedLine < lastLine; foldedLine++)
+					sink.level(sink.cookie, foldedLine, document.GetLevel(foldedLine));
+			}
+		} else {
+			foldedLine = document.LineFromPosition(lexedTo);
+		}
+		// the next Fold call reads the line before the one it starts at
+		document.Discard(std::min(foldedLine, document.LineFromPosition(lexedTo)) - 2);
+	}
+public:
+	LexerStream() : sink(), active(false), size(0), lexedTo(0), foldedLine(0),
+		runStart(0), runLength(0), runStyle(0) {
+	}
+	LexerStreamSink *Begin(LexerStreamSink *sink_) {
+		if (!sink_ || !sink_->styles)
+			return 0;
+		sink = *sink_;
+		document.Reset(sink.codePage);
+		active = true;
+		size = sink.size;
+		lexedTo = 0;
+		foldedLine = 0;
+		runLength = 0;
+		return sink_;
+	}
+	bool Active() const {
+		return active;
+	}
+	// Length of pAccess, or of the whole stream when it is the stream's
+	// document, as far as it is known when the stream starts.
+	Sci_Position Size(const Scintilla::IDocument *pAccess) const {
+		return active && pAccess == &document ? size : pAccess->Length();
+	}
+	LexerStreamChunk *Feed(Scintilla::ILexer5 *lexer, LexerStreamChunk *chunk) {
+		if (!active || !chunk || chunk->length < 0)
+			return 0;
+		if (size <= 0)
+			size = chunk->length;
+		document.Append(chunk->text, chunk->length);
+		Process(lexer, false);
+		return chunk;
+	}
+	void End(Scintilla::ILexer5 *lexer) {
+		if (!active)
+			return;
+		Process(lexer, true);
+		document.Reset(0);
+		active = false;
+	}
+};
+
+#endif // LEXERSTREAM_H
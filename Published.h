@@ -0,0 +1,79 @@
+/*
+ * Copyright 2018-2019 Kacper Kasper <kacperkasper@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+#ifndef PUBLISHED_H
+#define PUBLISHED_H
+
+#include <atomic>
+
+// An immutable T which one thread replaces while another reads it, without
+// either of them ever waiting (read-copy-update).
+//
+// The writer builds a new T and publishes it in place of the current one.
+// The reader holds on to the T which was current when it started until it
+// is done, the next reader gets the new one. There is at most one reader
+// at a time, as a lexer is only used by one thread at a time apart from
+// changing its tables, so the T in use is marked in a single hazard slot.
+//
+// Publish deletes the T it replaces unless the slot holds it. Then it is
+// put in the retired slot instead, and the reader deletes it when it is
+// done. A T retired earlier which is still there by then is no longer in
+// use, as the reader has moved on to a newer one, and Publish deletes it.
+//
+// Publish may only be called from one thread at a time.
+template <typename T>
+class Published {
+	std::atomic<const T *> current;
+	std::atomic<const T *> hazard;		// T the reader uses, or may be about to
+	std::atomic<const T *> retired;		// replaced T the reader may still use
+public:
+	explicit Published(const T *initial) : current(initial), hazard(nullptr), retired(nullptr) {
+	}
+	Published(const Published &) = delete;
+	Published &operator=(const Published &) = delete;
+	~Published() {
+		delete retired.load();
+		delete current.load();
+	}
+	void Publish(const T *next) {
+		const T *old = current.exchange(next);
+		if (hazard.load() != old) {
+			delete old;
+			return;
+		}
+		// not current any more, so a reader which did not use it yet will
+		// not start to, and the one which used it has let go of it if the
+		// hazard slot changed since
+		delete retired.exchange(old);
+	}
+
+	// Keeps the T current at its construction alive while it exists.
+	class Reader {
+		Published &published;
+		const T *snapshot;
+	public:
+		explicit Reader(Published &published_) : published(published_) {
+			// marked before it is checked to still be current, so Publish
+			// either sees the mark or replaced it before the check
+			do {
+				snapshot = published.current.load();
+				published.hazard.store(snapshot);
+			} while (published.current.load() != snapshot);
+		}
+		Reader(const Reader &) = delete;
+		Reader &operator=(const Reader &) = delete;
+		~Reader() {
+			published.hazard.store(nullptr);
+			delete published.retired.exchange(nullptr);
+		}
+		const T *operator->() const {
+			return snapshot;
+		}
+		const T &operator*() const {
+			return *snapshot;
+		}
+	};
+};
+
+#endif // PUBLISHED_H
@@ -0,0 +1,110 @@
+/*
+ * Copyright 2018-2019 Kacper Kasper <kacperkasper@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+#ifndef RUNINDEX_H
+#define RUNINDEX_H
+
+#include <algorithm>
+#include <vector>
+
+#include <ILexer.h>
+
+#include "SubStyles.h"
+
+#include "common.h"
+
+// Runs of characters of the same style written by Lex, kept in the form
+// handed out to hosts, so that they can walk tokens instead of styles.
+//
+// Runs are recorded as the styles are written, see BufferedDocument, and
+// cover the document from the start up to where the last Lex call got.
+class RunIndex {
+	std::vector<LexerRun> runs;
+	std::vector<LexerRun> kept;		// removed by the last Truncate
+	unsigned char primary[256];		// base style of every style
+
+	static bool Before(const LexerRun &run, Sci_Position p) {
+		return run.start + run.length <= p;
+	}
+	Sci_Position Covered() const {
+		return runs.empty() ? 0 : runs.back().start + runs.back().length;
+	}
+	// Cuts the run containing position, if any, in two.
+	static std::vector<LexerRun>::iterator Split(std::vector<LexerRun> &list, Sci_Position position) {
+		auto it = std::lower_bound(list.begin(), list.end(), position, Before);
+		if (it != list.end() && it->start < position) {
+			LexerRun tail = *it;
+			tail.length -= position - it->start;
+			tail.start = position;
+			it->length = position - it->start;
+			it = list.insert(it + 1, tail);
+		}
+		return it;
+	}
+public:
+	RunIndex() {
+		for (int style = 0; style < 256; style++)
+			primary[style] = style;
+	}
+	void Clear() {
+		runs.clear();
+		kept.clear();
+	}
+	// Forgets the runs from position on, before Lex starts there. With keep
+	// they can be brought back by Restore. Styles written are taken to be
+	// substyles as subStyles says.
+	void Truncate(Sci_Position position, const Lexilla::SubStyles &subStyles, bool keep = false) {
+		const auto first = Split(runs, position);
+		kept.clear();
+		if (keep)
+			kept.insert(kept.end(), first, runs.end());
+		runs.erase(first, runs.end());
+		for (int style = 0; style < 256; style++)
+			primary[style] = subStyles.BaseStyle(style);
+	}
+	void Add(Sci_Position position, Sci_Position length, int style) {
+		if (length <= 0)
+			return;
+		if (!runs.empty()) {
+			LexerRun &last = runs.back();
+			if (position < last.start + last.length)
+				runs.erase(Split(runs, position), runs.end());
+		}
+		if (!runs.empty()) {
+			LexerRun &last = runs.back();
+			if (last.start + last.length == position && (last.subStyle < 0 ? last.style : last.subStyle) == style) {
+				last.length += length;
+				return;
+			}
+		}
+		const int base = primary[style];
+		runs.push_back({ position, length, base, base == style ? -1 : style });
+	}
+	// Adds back the runs removed by Truncate from position on, moved by
+	// delta, up to end, which Lex found unchanged. The text after end may
+	// have been edited since. Where no runs were kept, as no earlier call
+	// recorded that far, they are made from the styles of doc.
+	void Restore(Sci_Position position, Sci_Position delta, Sci_Position end,
+		Scintilla::IDocument *doc) {
+		for (auto it = Split(kept, position); it != kept.end() && it->start + delta < end; ++it) {
+			const int style = it->subStyle < 0 ? it->style : it->subStyle;
+			Add(it->start + delta, std::min(it->length, end - it->start - delta), style);
+		}
+		kept.clear();
+		for (Sci_Position at = Covered(); at < end; at++)
+			Add(at, 1, static_cast<unsigned char>(doc->StyleAt(at)));
+	}
+	// Answers a LEXER_CALL_RUNS PrivateCall.
+	LexerRunQuery *Query(LexerRunQuery *query) const {
+		query->end = std::min(query->end, Covered());
+		const auto first = std::lower_bound(runs.begin(), runs.end(), query->start, Before);
+		const auto last = std::lower_bound(first, runs.end(), query->end,
+			[](const LexerRun &run, Sci_Position p) { return run.start < p; });
+		query->runs = first == last ? nullptr : &*first;
+		query->count = static_cast<int>(last - first);
+		return query;
+	}
+};
+
+#endif // RUNINDEX_H
@@ -0,0 +1,132 @@
+/*
+ * Copyright 2018-2019 Kacper Kasper <kacperkasper@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+#ifndef RUNSKIP_H
+#define RUNSKIP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Run-skipping tables shared by the lexers in this package.
+//
+// A lexer describes its character classes and, for every state, the
+// characters which leave that state without anything happening. Both are
+// compiled into dense constexpr tables. The main loop then skips those
+// runs in a tight loop and only calls the lexer's own code (comparisons
+// with chPrev, keyword lookups, multi-character matches) at characters
+// where something may happen. The transitions themselves stay in that
+// code.
+
+// Set of characters. Bytes are looked up directly, characters above 0xFF
+// (decoded UTF-8) all share one flag.
+class CharClass {
+	uint64_t bits[4];
+	bool wide;
+	constexpr void Add(int ch) {
+		bits[ch >> 6] |= uint64_t(1) << (ch & 63);
+	}
+public:
+	// The empty set.
+	constexpr CharClass() : bits{0, 0, 0, 0}, wide(false) {
+	}
+	static constexpr CharClass Of(const char *members) {
+		CharClass result;
+		for (; *members; members++)
+			result.Add(static_cast<unsigned char>(*members));
+		return result;
+	}
+	static constexpr CharClass Range(int first, int last) {
+		CharClass result;
+		for (int ch = first; ch <= last; ch++)
+			result.Add(ch);
+		return result;
+	}
+	// Only characters above 0xFF.
+	static constexpr CharClass Wide() {
+		CharClass result;
+		result.wide = true;
+		return result;
+	}
+	// Every byte from 0x80 up and all wide characters.
+	static constexpr CharClass NonASCII() {
+		return Range(0x80, 0xFF) | Wide();
+	}
+	static constexpr CharClass Nul() {
+		CharClass result;
+		result.Add(0);
+		return result;
+	}
+	constexpr CharClass operator|(const CharClass &other) const {
+		CharClass result;
+		for (int i = 0; i < 4; i++)
+			result.bits[i] = bits[i] | other.bits[i];
+		result.wide = wide || other.wide;
+		return result;
+	}
+	constexpr CharClass operator&(const CharClass &other) const {
+		CharClass result;
+		for (int i = 0; i < 4; i++)
+			result.bits[i] = bits[i] & other.bits[i];
+		result.wide = wide && other.wide;
+		return result;
+	}
+	constexpr CharClass operator~() const {
+		CharClass result;
+		for (int i = 0; i < 4; i++)
+			result.bits[i] = ~bits[i];
+		result.wide = !wide;
+		return result;
+	}
+	constexpr CharClass operator-(const CharClass &other) const {
+		return *this & ~other;
+	}
+	constexpr bool Contains(int ch) const {
+		if (ch < 0 || ch > 0xFF)
+			return ch > 0xFF && wide;
+		return (bits[ch >> 6] >> (ch & 63)) & 1;
+	}
+};
+
+// Characters that keep a state going, indexed by state. States without a
+// rule, including substyles, never skip.
+struct RunRule {
+	int state;
+	CharClass stay;
+};
+
+template <int states>
+class RunTable {
+	CharClass stay[states + 1];
+public:
+	template <size_t rules>
+	constexpr RunTable(const RunRule (&description)[rules]) : stay{} {
+		for (size_t r = 0; r < rules; r++)
+			stay[description[r].state] = description[r].stay;
+	}
+	constexpr const CharClass &For(int state) const {
+		return (state >= 0 && state < states) ? stay[state] : stay[states];
+	}
+	// The same table with runs stopping at any of chars.
+	constexpr RunTable Without(const CharClass &chars) const {
+		RunTable result = *this;
+		for (int state = 0; state <= states; state++)
+			result.stay[state] = stay[state] - chars;
+		return result;
+	}
+};
+
+// Moves the context over characters that do nothing in the current state.
+// Stops before the end of the range so the lexer sees its last character.
+// Returns whether anything was skipped.
+template <typename Context>
+inline bool SkipRun(Context &sc, const CharClass &stay) {
+	bool skipped = false;
+	while (sc.More() && stay.Contains(sc.ch)) {
+		sc.Forward();
+		skipped = true;
+	}
+	return skipped;
+}
+
+#endif // RUNSKIP_H
@@ -0,0 +1,189 @@
+/*
+ * Copyright 2018-2019 Kacper Kasper <kacperkasper@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+#ifndef STYLEBUFFER_H
+#define STYLEBUFFER_H
+
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+
+#include <ILexer.h>
+
+#include "RunIndex.h"
+
+// Per-instance storage for styles written during a Lex call. Nothing is
+// allocated until a call needs it. It is then made as large as the range
+// being lexed, up to the configured size, and only grows after that, so an
+// instance which only restyles the screen keeps a small one.
+class StyleBuffer {
+	std::vector<char> styles;
+	int limit;
+	int flushes;
+	friend class BufferedDocument;
+public:
+	StyleBuffer() : limit(0), flushes(0) {
+	}
+	// Called before lexing length bytes with a buffer of at most size.
+	void Resize(int size, Sci_Position length) {
+		limit = std::max(size, 0);
+		if (styles.size() > static_cast<size_t>(limit)) {
+			styles.resize(limit);
+			styles.shrink_to_fit();
+		}
+		const size_t wanted = std::min<Sci_Position>(std::max<Sci_Position>(length, 0), limit);
+		if (styles.size() < wanted)
+			styles.resize(std::min<size_t>(std::max(wanted, 2 * styles.size()), limit));
+	}
+	bool Enabled() const {
+		return limit > 0;
+	}
+	// Number of IDocument::SetStyles and SetStyleFor calls made on the
+	// document by the last Lex call.
+	int Flushes() const {
+		return flushes;
+	}
+};
+
+// IDocument wrapper that collects styles written by LexAccessor in a
+// StyleBuffer and passes them on to the document in a few large
+// SetStyles calls. Everything else is forwarded unchanged. Styles are also
+// recorded as runs if there is a RunIndex.
+class BufferedDocument : public Scintilla::IDocument {
+	Scintilla::IDocument *pAccess;
+	StyleBuffer &buffer;
+	RunIndex *runs;
+	Sci_Position startPos;
+	Sci_Position validLen;
+public:
+	BufferedDocument(Scintilla::IDocument *pAccess_, StyleBuffer &buffer_, RunIndex *runs_ = nullptr) :
+		pAccess(pAccess_), buffer(buffer_), runs(runs_), startPos(0), validLen(0) {
+		buffer.flushes = 0;
+	}
+	BufferedDocument(const BufferedDocument &) = delete;
+	BufferedDocument &operator=(const BufferedDocument &) = delete;
+	virtual ~BufferedDocument() {
+		Flush();
+	}
+	void Flush() {
+		if (validLen > 0) {
+			pAccess->SetStyles(validLen, buffer.styles.data());
+			buffer.flushes++;
+			startPos += validLen;
+			validLen = 0;
+		}
+	}
+
+	void SCI_METHOD StartStyling(Sci_Position position) override {
+		Flush();
+		pAccess->StartStyling(position);
+		startPos = position;
+	}
+	bool SCI_METHOD SetStyleFor(Sci_Position length, char style) override {
+		if (runs)
+			runs->Add(startPos + validLen, length, static_cast<unsigned char>(style));
+		const Sci_Position size = buffer.styles.size();
+		if (validLen + length > size)
+			Flush();
+		if (length >= size) {
+			buffer.flushes++;
+			startPos += length;
+			return pAccess->SetStyleFor(length, style);
+		}
+		memset(buffer.styles.data() + validLen, style, length);
+		validLen += length;
+		return true;
+	}
+	bool SCI_METHOD SetStyles(Sci_Position length, const char *styles) override {
+		if (runs) {
+			Sci_Position start = 0;
+			for (Sci_Position i = 1; i <= length; i++) {
+				if (i == length || styles[i] != styles[start]) {
+					runs->Add(startPos + validLen + start, i - start, static_cast<unsigned char>(styles[start]));
+					start = i;
+				}
+			}
+		}
+		const Sci_Position size = buffer.styles.size();
+		if (validLen + length > size)
+			Flush();
+		if (length >= size) {
+			buffer.flushes++;
+			startPos += length;
+			return pAccess->SetStyles(length, styles);
+		}
+		memcpy(buffer.styles.data() + validLen, styles, length);
+		validLen += length;
+		return true;
+	}
+	char SCI_METHOD StyleAt(Sci_Position position) const override {
+		if (position >= startPos && position < startPos + validLen)
+			return buffer.styles[position - startPos];
+		return pAccess->StyleAt(position);
+	}
+
+	int SCI_METHOD Version() const override {
+		return pAccess->Version();
+	}
+	void SCI_METHOD SetErrorStatus(int status) override {
+		pAccess->SetErrorStatus(status);
+	}
+	Sci_Position SCI_METHOD Length() const override {
+		return pAccess->Length();
+	}
+	void SCI_METHOD GetCharRange(char *buffer_, Sci_Position position, Sci_Position lengthRetrieve) const override {
+		pAccess->GetCharRange(buffer_, position, lengthRetrieve);
+	}
+	Sci_Position SCI_METHOD LineFromPosition(Sci_Position position) const override {
+		return pAccess->LineFromPosition(position);
+	}
+	Sci_Position SCI_METHOD LineStart(Sci_Position line) const override {
+		return pAccess->LineStart(line);
+	}
+	int SCI_METHOD GetLevel(Sci_Position line) const override {
+		return pAccess->GetLevel(line);
+	}
+	int SCI_METHOD SetLevel(Sci_Position line, int level) override {
+		return pAccess->SetLevel(line, level);
+	}
+	int SCI_METHOD GetLineState(Sci_Position line) const override {
+		return pAccess->GetLineState(line);
+	}
+	int SCI_METHOD SetLineState(Sci_Position line, int state) override {
+		return pAccess->SetLineState(line, state);
+	}
+	void SCI_METHOD DecorationSetCurrentIndicator(int indicator) override {
+		pAccess->DecorationSetCurrentIndicator(indicator);
+	}
+	void SCI_METHOD DecorationFillRange(Sci_Position position, int value, Sci_Position fillLength) override {
+		pAccess->DecorationFillRange(position, value, fillLength);
+	}
+	void SCI_METHOD ChangeLexerState(Sci_Position start, Sci_Position end) override {
+		pAccess->ChangeLexerState(start, end);
+	}
+	int SCI_METHOD CodePage() const override {
+		return pAccess->CodePage();
+	}
+	bool SCI_METHOD IsDBCSLeadByte(char ch) const override {
+		return pAccess->IsDBCSLeadByte(ch);
+	}
+	const char * SCI_METHOD BufferPointer() override {
+		return pAccess->BufferPointer();
+	}
+	int SCI_METHOD GetLineIndentation(Sci_Position line) override {
+		return pAccess->GetLineIndentation(line);
+	}
+	Sci_Position SCI_METHOD LineEnd(Sci_Position line) const override {
+		return pAccess->LineEnd(line);
+	}
+	Sci_Position SCI_METHOD GetRelativePosition(Sci_Position positionStart, Sci_Position characterOffset) const override {
+		return pAccess->GetRelativePosition(positionStart, characterOffset);
+	}
+	int SCI_METHOD GetCharacterAndWidth(Sci_Position position, Sci_Position *pWidth) const override {
+		return pAccess->GetCharacterAndWidth(position, pWidth);
+	}
+};
+
+#endif // STYLEBUFFER_H
@@ -0,0 +1,204 @@
+/*
+ * Copyright 2018-2019 Kacper Kasper <kacperkasper@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+#ifndef TOKENSTREAM_H
+#define TOKENSTREAM_H
+
+#include <algorithm>
+
+#include <ILexer.h>
+
+#include "GapVector.h"
+
+// Record of what Lex produced, one entry per line: a hash of its text and
+// the lexer state at its end. It lets Lex stop early after an edit.
+//
+// Scintilla moves styles along with the text, so once lexing after an edit
+// reaches a line which only moved, and is in the same state it was in the
+// last time it got there, everything after it is already styled. Lex only
+// ever starts at line starts and the lexers can resume exactly there, which
+// is why lines rather than single tokens are recorded.
+//
+// Checking costs as much as the edit does. An edit puts the end of styled
+// text back to where it was made, so the call starts before the first edit
+// since the last one. The lines of the last call are hashed where they were
+// until one changed, which is where that edit is, and Lex cannot stop
+// before it. After it only the first line which matches is hashed again.
+// Later edits which changed the length of the text move the lines after
+// them by another amount, so no line between the edits matches. What is
+// not noticed is text after the matching line replaced by text of the same
+// length before the call, such as by a replace all; hosts doing that should
+// restyle the range they replaced in.
+//
+// The lines after the call sit after the gap of a GapVector, so moving them
+// by the length the document gained costs nothing either.
+//
+// State is the lexer's resume state, it must have a position member and
+// Same(), which compares everything else.
+template <typename State>
+class TokenStream {
+	struct Record {
+		Sci_Position start;
+		Sci_Position length;
+		unsigned int hash;	// of the text and the characters after it Lex looks at
+		State end;
+
+		Sci_Position End() const {
+			return start + length;
+		}
+		void Move(Sci_Position delta) {
+			start += delta;
+			end.position += delta;
+		}
+	};
+	enum { lookahead = 2 };
+	GapVector<Record> lines;	// of the current call before the gap
+	Sci_Position documentLength;
+
+	// current call
+	Scintilla::IDocument *pAccess;
+	Sci_Position delta;		// change of document length since the last call
+	Sci_Position lineStart;
+	Sci_Position rangeEnd;
+	Sci_Position retryFrom;	// text before this position is known to have changed
+	bool reused;
+	bool lastSet;			// whether last is set
+	Record last;			// of the last call, the last one before the line Lex got to
+
+	unsigned int Hash(Sci_Position start, Sci_Position length) const {
+		const Sci_Position end = std::min(start + length + lookahead, pAccess->Length());
+		unsigned int hash = 2166136261u;
+		char buffer[256];
+		for (Sci_Position position = start; position < end; position += sizeof(buffer)) {
+			const Sci_Position count = std::min<Sci_Position>(sizeof(buffer), end - position);
+			pAccess->GetCharRange(buffer, position, count);
+			for (Sci_Position i = 0; i < count; i++)
+				hash = (hash ^ static_cast<unsigned char>(buffer[i])) * 16777619u;
+		}
+		return hash;
+	}
+	// First line from low on which ends at or after position.
+	size_t EndingFrom(size_t low, Sci_Position position) const {
+		return lines.LowerBound(low, position,
+			[](const Record &line, Sci_Position p) { return line.End() < p; });
+	}
+	// Whether the text of the first line of the last call after the gap is
+	// still there, and the state at the end of the range is known.
+	bool Unchanged() {
+		const Record old = lines.Get(lines.GapStart());
+		if (Hash(old.start, old.length) != old.hash) {
+			retryFrom = old.End();
+			return false;
+		}
+		// the state at the end of the range is needed to carry on from there,
+		// and a line ending there is what shows that the lines got that far,
+		// even at the end of the document, as the text after the lines was
+		// not necessarily styled since it last changed
+		const size_t line = EndingFrom(lines.GapStart(), rangeEnd);
+		if (line == lines.Size() || lines.Get(line).End() != rangeEnd) {
+			retryFrom = rangeEnd;
+			return false;
+		}
+		return true;
+	}
+public:
+	TokenStream() : documentLength(0), pAccess(nullptr), delta(0), lineStart(0),
+		rangeEnd(0), retryFrom(0), reused(false), lastSet(false), last() {
+	}
+	void Invalidate() {
+		lines.Clear();
+	}
+	// start is the state the call starts in.
+	void Begin(Scintilla::IDocument *pAccess_, Sci_Position startPos, Sci_Position length,
+		const State &start) {
+		// a call from the start is also what hosts make when they throw all
+		// styles away, which the range being unchanged shows below, so the
+		// lines are only forgotten for another document
+		if (pAccess_ != pAccess)
+			lines.Clear();
+		pAccess = pAccess_;
+		// lines skipped over in a single run are recorded together, so the
+		// call may start in the middle of one
+		lines.MoveGap(EndingFrom(0, startPos + 1));
+		// the text after the call start is styled from the state the call
+		// starts in, and the lines before only lead into it if they ended in
+		// that state, which they need not have: the lexers do not resume all
+		// of it, and the call may start in the middle of a line
+		if (lines.GapStart() > 0) {
+			Record &before = lines[lines.GapStart() - 1];
+			if (before.End() == startPos && before.end.Same(start)) {
+				// it looks ahead into the text after it
+				before.hash = Hash(before.start, before.length);
+			} else {
+				const size_t count = lines.GapStart();
+				lines.MoveGap(0);
+				lines.EraseAfterGap(count);
+			}
+		}
+		lineStart = startPos;
+		rangeEnd = startPos + length;
+		// nothing can be reused if the range did not change at all
+		retryFrom = pAccess->Length() + 1;
+		for (size_t line = lines.GapStart(); line < lines.Size(); line++) {
+			const Record old = lines.Get(line);
+			if (old.start >= rangeEnd)
+				break;
+			if (Hash(old.start, old.length) != old.hash) {
+				retryFrom = old.End();
+				break;
+			}
+		}
+		delta = pAccess->Length() - documentLength;
+		documentLength = pAccess->Length();
+		lines.Shift(delta);
+		reused = false;
+		// the line before the call, where the ones after the gap moved to
+		lastSet = lines.GapStart() > 0;
+		if (lastSet) {
+			last = lines.Get(lines.GapStart() - 1);
+			last.Move(delta);
+		}
+	}
+	// Called at every line start Lex gets to, and at the end of the
+	// document. Returns true when the rest of the range is already styled.
+	bool Line(Sci_Position position, const State &state) {
+		if (position <= lineStart || position > pAccess->Length())
+			return false;
+		lines.Insert({ lineStart, position - lineStart, Hash(lineStart, position - lineStart), state });
+		lineStart = position;
+		// the lines of the last call Lex got past
+		while (lines.Size() > lines.GapStart() && lines.Get(lines.GapStart()).start < position) {
+			last = lines.Get(lines.GapStart());
+			lastSet = true;
+			lines.EraseAfterGap();
+		}
+		if (position < retryFrom || !lastSet || lines.Size() == lines.GapStart())
+			return false;
+		if (lines.Get(lines.GapStart()).start != position || last.End() != position
+			|| !last.end.Same(state) || !Unchanged())
+			return false;
+		reused = true;
+		return true;
+	}
+	// Keeps the lines of the last call after the current one if they were
+	// reused, forgets them otherwise.
+	void End() {
+		if (!reused)
+			lines.EraseAfterGap(lines.Size() - lines.GapStart());
+	}
+	// Change of document length since the last call.
+	Sci_Position Delta() const {
+		return delta;
+	}
+	// State at the end of the line ending at position, after End.
+	bool StateAt(Sci_Position position, State &state) const {
+		const size_t line = EndingFrom(0, position);
+		if (line == lines.Size() || lines.Get(line).End() != position)
+			return false;
+		state = lines.Get(line).end;
+		return true;
+	}
+};
+
+#endif // TOKENSTREAM_H
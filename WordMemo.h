@@ -0,0 +1,66 @@
+/*
+ * Copyright 2018-2019 Kacper Kasper <kacperkasper@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+#ifndef WORDMEMO_H
+#define WORDMEMO_H
+
+#include <string.h>
+
+// Remembers the style words were classified as, so that the word lists and
+// substyles are only searched once for words which keep coming back.
+//
+// Direct-mapped: a word goes into the slot picked by its hash, replacing
+// whatever was there. Longer words are not remembered. Clear only starts a
+// new generation, entries from older ones never match.
+class WordMemo {
+	enum { slots = 512, wordLength = 23 };
+	struct Slot {
+		unsigned int generation;
+		int style;
+		char word[wordLength + 1];
+	};
+	Slot table[slots];
+	unsigned int generation;
+
+	static unsigned int Hash(const char *word, size_t &length) {
+		unsigned int hash = 2166136261u;
+		const char *s = word;
+		for (; *s; s++)
+			hash = (hash ^ static_cast<unsigned char>(*s)) * 16777619u;
+		length = s - word;
+		return hash;
+	}
+public:
+	WordMemo() : table{}, generation(1) {
+	}
+	void Clear() {
+		generation++;
+		if (generation == 0) {
+			// wrapped around, old entries could match again
+			for (Slot &slot : table)
+				slot.generation = 0;
+			generation = 1;
+		}
+	}
+	// Style remembered for word, or -1.
+	int Find(const char *word) const {
+		size_t length;
+		const Slot &slot = table[Hash(word, length) % slots];
+		if (slot.generation != generation || length > wordLength
+			|| memcmp(slot.word, word, length + 1) != 0)
+			return -1;
+		return slot.style;
+	}
+	void Add(const char *word, int style) {
+		size_t length;
+		Slot &slot = table[Hash(word, length) % slots];
+		if (length > wordLength)
+			return;
+		memcpy(slot.word, word, length + 1);
+		slot.style = style;
+		slot.generation = generation;
+	}
+};
+
+#endif // WORDMEMO_H
@@ -0,0 +1,37 @@
+/*
+ * Copyright 2018-2019 Kacper Kasper <kacperkasper@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+#ifndef WORKBUDGET_H
+#define WORKBUDGET_H
+
+#include <chrono>
+
+#include <ILexer.h>
+
+// Decides when a Lex call has done enough work and should stop at the next
+// clean boundary. A limit of 0 means unlimited.
+class WorkBudget {
+	Sci_PositionU startPos;
+	Sci_PositionU limitPos;
+	bool timed;
+	std::chrono::steady_clock::time_point deadline;
+public:
+	WorkBudget(Sci_PositionU startPos_, int bytes, int milliseconds) :
+		startPos(startPos_), limitPos(static_cast<Sci_PositionU>(-1)),
+		timed(milliseconds > 0) {
+		if (bytes > 0)
+			limitPos = startPos + bytes;
+		if (timed)
+			deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(milliseconds);
+	}
+	// Never true at the start position so every call makes progress.
+	bool Exhausted(Sci_PositionU position) const {
+		if (position <= startPos)
+			return false;
+		return position >= limitPos
+			|| (timed && std::chrono::steady_clock::now() >= deadline);
+	}
+};
+
+#endif // WORKBUDGET_H
@@ -12,4 +12,185 @@
 
 typedef Scintilla::ILexer5 *(*LexerFactoryFunction)();
 
+// Operations understood by ILexer5::PrivateCall of the lexers in this package
+enum {
+	LEXER_CALL_STATUS = 1,			// returns const LexerStatus *, pointer is unused
+	LEXER_CALL_LATENCY = 2,			// fills and returns the LexerLatency * passed in
+	LEXER_CALL_LATENCY_RESET = 3,	// forgets the recorded latencies and starts
+									// recording, which is off until then
+	LEXER_CALL_FOLD_AT = 4,			// fills and returns the LexerFoldQuery * passed
+									// in with the innermost fold containing line
+	LEXER_CALL_FOLD_NEXT = 5,		// same with the first fold starting after line
+	LEXER_CALL_FOLD_PREVIOUS = 6,	// same with the last fold starting before line
+	LEXER_CALL_FOLD_GET = 7,		// same with the fold numbered index
+	LEXER_CALL_BRACE_MATCH = 8,		// fills and returns the LexerBraceQuery * passed
+									// in with the pair of the bracket at position
+	LEXER_CALL_BRACE_ENCLOSING = 9,	// same with the innermost pair around position
+	LEXER_CALL_STREAM_BEGIN = 10,	// starts a stream sending to the LexerStreamSink *
+									// passed in, returns it or 0 if it is unusable
+	LEXER_CALL_STREAM_FEED = 11,	// styles the next LexerStreamChunk * passed in,
+									// returns it or 0 if no stream was started
+	LEXER_CALL_STREAM_END = 12,		// styles the rest of the stream, pointer is unused
+	LEXER_CALL_KEYWORDS_USE = 13,	// uses the compiled set of the LexerKeywordSet *
+									// passed in as a word list, returns it or 0 if
+									// the set is not one this lexer can use
+	LEXER_CALL_KEYWORDS_GET = 14,	// fills and returns the LexerKeywordSet * passed
+									// in with the compiled form of a word list
+	LEXER_CALL_RUNS = 15,			// fills and returns the LexerRunQuery * passed
+									// in with the style runs of a range, or returns
+									// 0 if runs are not recorded
+	LEXER_CALL_VERIFY = 16,			// fills and returns the LexerVerify * passed in,
+									// or returns 0 if built without LEXER_VERIFY
+	LEXER_CALL_VERIFY_RESET = 17,	// forgets the verify results, pointer is unused
+	LEXER_CALL_LATENCY_STOP = 18	// stops recording latencies, pointer is unused
+};
+
+// Styling modes reported in LexerStatus::mode
+enum {
+	LEXER_MODE_FULL,		// all features enabled
+	LEXER_MODE_REDUCED		// document is above the huge document threshold
+};
+
+struct LexerStatus {
+	int mode;				// mode used by the last Lex call
+	Sci_Position lexedTo;	// position the last Lex call stopped at
+	int stopped;			// non-zero if it ran out of budget before the end
+							// of its range; continue by lexing from lexedTo
+	Sci_Position foldedTo;	// position the last Fold call stopped at
+	int styleFlushes;		// style writes made to the document by the last Lex call
+};
+
+// Percentiles over the most recent calls recorded since
+// LEXER_CALL_LATENCY_RESET, in microseconds. "total" is a Lex call together
+// with the Fold call following it, which is what a keystroke costs in
+// Scintilla.
+struct LexerLatency {
+	int samples;
+	double lexP50;
+	double lexP99;
+	double foldP50;
+	double foldP99;
+	double totalP50;
+	double totalP99;
+};
+
+// Kinds of fold ranges in LexerFold::kind
+enum {
+	LEXER_FOLD_ANY,			// only in queries, matches every kind
+	LEXER_FOLD_BLOCK,		// braces not belonging to any of the below
+	LEXER_FOLD_RULE,		// body of a Jam rule
+	LEXER_FOLD_ACTIONS,		// body of Jam actions
+	LEXER_FOLD_COMMENT,		// consecutive comment lines
+	LEXER_FOLD_FUNCTION,	// function, sub, procedure and the like
+	LEXER_FOLD_TYPE,		// type, structure, enumeration and the like
+	LEXER_FOLD_EXPLICIT,	// between explicit fold markers
+	LEXER_FOLD_KINDS
+};
+
+// A fold found by the Fold calls so far. Folds are numbered in the order of
+// their header lines, so a parent always has a lower number than its children.
+struct LexerFold {
+	Sci_Position startLine;	// header line
+	Sci_Position endLine;	// last line of the fold, -1 if it is still open at
+							// LexerStatus::foldedTo
+	int level;				// fold level of the header line
+	int kind;
+	int parent;				// number of the enclosing fold, -1 at top level
+};
+
+struct LexerFoldQuery {
+	int kind;				// LEXER_FOLD_ANY or the kind to look for
+	Sci_Position line;		// line to search from
+	int index;				// found fold, -1 if there is none; input of
+							// LEXER_CALL_FOLD_GET
+	LexerFold fold;			// copy of the found fold
+};
+
+// Bracket pairs found by the Lex calls so far. Brackets are paired by type
+// like SCI_BRACEMATCH does, only ones styled as operators count. Brackets
+// at or after LexerStatus::lexedTo are not known, as the text there may
+// have changed since Lex got to it, and are answered with -1.
+struct LexerBraceQuery {
+	Sci_Position position;	// bracket to match, or caret position to find
+							// the pair around: open < position <= close
+	int brace;				// LEXER_CALL_BRACE_ENCLOSING only: opening
+							// bracket to look for, 0 for any
+	Sci_Position open;		// opening bracket, -1 if none
+	Sci_Position close;		// closing bracket, -1 if none
+};
+
+// Receives the results of a stream, in order. Styles of a run are sent
+// once the lexer is done with all of it, levels once a line and the one
+// after it have been folded. Folding is skipped if level is 0.
+struct LexerStreamSink {
+	int codePage;			// of the stream, SC_CP_UTF8 or 0 for single bytes
+	void *cookie;			// passed to the functions below
+	void (*styles)(void *cookie, Sci_Position position, Sci_Position length, int style);
+	void (*level)(void *cookie, Sci_Position line, int level);
+	Sci_Position size;		// length of the whole stream, 0 if unknown; the
+							// huge document threshold is compared to it, or
+							// to the length of the first chunk
+};
+
+struct LexerStreamChunk {
+	const char *text;		// only used during the call
+	Sci_Position length;
+};
+
+// A word list compiled into the format described in KeywordSet.h, which
+// can be written to a file and mapped back in. A set in use is read where
+// it is, so data has to stay valid until the word list is set again or the
+// lexer is released. Data gotten from a lexer is valid until the word list
+// changes.
+struct LexerKeywordSet {
+	int list;				// word list, as numbered by WordListSet
+	const void *data;		// 4-byte aligned
+	size_t size;			// in bytes
+};
+
+// A run of characters of the same style, as written by the Lex calls so far.
+struct LexerRun {
+	Sci_Position start;
+	Sci_Position length;
+	int style;				// primary style
+	int subStyle;			// style written if it is a substyle of style, else -1
+};
+
+// Runs are pointed to where the lexer keeps them, they stay valid until the
+// next Lex or LEXER_CALL_STREAM_* call.
+struct LexerRunQuery {
+	Sci_Position start;		// range to get the runs of
+	Sci_Position end;		// cut to the end of the runs recorded so far
+	const LexerRun *runs;	// first run overlapping the range, 0 if none
+	int count;				// number of runs overlapping the range
+};
+
+// Results of the verify mode, in which every Lex and Fold call is made
+// again by a reference lexer with the fast paths turned off, writing to a
+// copy of the document, and the styles and levels both wrote are compared.
+// The answers of the indexes are compared with those of indexes built
+// again from the document. Times are totals in microseconds. The verify
+// mode is only built into lexers compiled with LEXER_VERIFY, as the tests
+// do.
+struct LexerVerify {
+	int calls;				// Lex and Fold calls verified
+	int divergences;		// calls after which the results differed
+	Sci_Position callStart;	// start of the range of the first such call
+	int callInitStyle;		// and its initial style, -1 for Fold calls
+	Sci_Position position;	// first style which differed, -1 if none
+	int style;				// written there
+	int referenceStyle;		// written there by the reference lexer
+	Sci_Position line;		// first fold level which differed, -1 if none
+	int level;
+	int referenceLevel;
+	int query;				// first index query whose answer differed,
+							// LEXER_CALL_FOLD_AT, _FOLD_NEXT, _BRACE_MATCH
+							// or _RUNS, 0 if none
+	Sci_Position queryAt;	// line or position it was asked about
+	double lexTime;
+	double referenceLexTime;
+	double foldTime;
+	double referenceFoldTime;
+};
+
 #endif // _H
@@ -0,0 +1,124 @@
+/*
+ * Copyright 2018-2019 Kacper Kasper <kacperkasper@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+
+// Checks that Lex and Fold do not allocate once they have styled a
+// document: every call is counted through the global operator new, which
+// the lexer loaded by this program uses too.
+//
+//	AllocationCount LexJam.so jam [name=value...]
+//
+// The first calls may size the lexer's buffers and indexes. Once they have
+// seen the text, restyling the whole document, its second half and the
+// lines around small edits has to make no allocation at all.
+
+#include <new>
+#include <utility>
+#include <vector>
+
+#include "TestCorpus.h"
+#include "TestDocument.h"
+#include "TestLexer.h"
+
+namespace {
+
+long allocations = 0;
+
+void *Allocate(size_t size) {
+	allocations++;
+	void *memory = malloc(size ? size : 1);
+	if (!memory)
+		throw std::bad_alloc();
+	return memory;
+}
+
+}
+
+void *operator new(size_t size) {
+	return Allocate(size);
+}
+
+void *operator new[](size_t size) {
+	return Allocate(size);
+}
+
+void operator delete(void *memory) noexcept {
+	free(memory);
+}
+
+void operator delete[](void *memory) noexcept {
+	free(memory);
+}
+
+void operator delete(void *memory, size_t) noexcept {
+	free(memory);
+}
+
+void operator delete[](void *memory, size_t) noexcept {
+	free(memory);
+}
+
+namespace {
+
+// Lexes and folds from the start of the line of position to end. If check,
+// neither call may allocate.
+void Restyle(Scintilla::ILexer5 *lexer, TestDocument &doc, Sci_Position position, Sci_Position end,
+	const char *what, bool check = true) {
+	const Sci_Position start = doc.LineStart(doc.LineFromPosition(position));
+	const int initStyle = start > 0 ? static_cast<unsigned char>(doc.StyleAt(start - 1)) : 0;
+	long before = allocations;
+	lexer->Lex(start, end - start, initStyle, &doc);
+	CHECK(!check || allocations == before, "Lex %s: %ld allocations", what, allocations - before);
+	before = allocations;
+	lexer->Fold(start, end - start, initStyle, &doc);
+	CHECK(!check || allocations == before, "Fold %s: %ld allocations", what, allocations - before);
+}
+
+// Replaces the character at position and restyles the screen around it.
+void Replace(Scintilla::ILexer5 *lexer, TestDocument &doc, Sci_Position position, char ch, bool check) {
+	doc.Delete(position, 1);
+	doc.Insert(position, std::string(1, ch));
+	const Sci_Position end = doc.LineStart(doc.LineFromPosition(position) + 60);
+	Restyle(lexer, doc, position, end, "after an edit", check);
+}
+
+}
+
+int main(int argc, char **argv) {
+	if (argc < 3) {
+		fprintf(stderr, "usage: %s LexJam.so|LexYAB.so jam|yab [name=value...]\n", argv[0]);
+		return 2;
+	}
+	const char *name = argv[2];
+	Scintilla::ILexer5 *lexer = LoadLexer(argv[1], name);
+	ConfigureLexer(lexer, name);
+	SetProperties(lexer, argc - 3, argv + 3);
+	TestDocument doc(Corpus(2).Generate(name, 1024 * 1024));
+
+	// Edits replace a character, so the lines stay as they are. Edits can
+	// make an index bigger than it ever was, which may allocate, so they
+	// are made, undone, and only checked when they are made again.
+	std::mt19937 rng(3);
+	std::vector<std::pair<Sci_Position, char>> edits;
+	while (edits.size() < 100) {
+		const Sci_Position position = rng() % doc.Length();
+		if (doc.text[position] != '\r' && doc.text[position] != '\n')
+			edits.push_back({ position, edits.size() % 2 ? 'x' : '"' });
+	}
+	for (int pass = 0; pass < 3; pass++) {
+		const bool check = pass == 2;
+		Restyle(lexer, doc, 0, doc.Length(), "of the whole document", check);
+		Restyle(lexer, doc, doc.Length() / 2, doc.Length(), "of the second half", check);
+		std::vector<char> replaced;
+		for (const std::pair<Sci_Position, char> &edit : edits) {
+			replaced.push_back(doc.text[edit.first]);
+			Replace(lexer, doc, edit.first, edit.second, check);
+		}
+		for (size_t i = edits.size(); i-- > 0;)
+			Replace(lexer, doc, edits[i].first, replaced[i], false);
+	}
+
+	lexer->Release();
+	return failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,382 @@
+/*
+ * Copyright 2018-2019 Kacper Kasper <kacperkasper@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+#ifndef DUALRUN_H
+#define DUALRUN_H
+
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#include <ILexer.h>
+#include <Scintilla.h>
+
+#include "common.h"
+#include "BraceIndex.h"
+#include "FoldIndex.h"
+#include "RunIndex.h"
+
+// IDocument wrapper keeping the styles and fold levels written through it
+// instead of passing them on, so the document is left as it is. They are
+// read back in place of the document's own, and kept between calls, so a
+// lexer writing to it only ever sees what it wrote itself.
+class RecordingDocument : public Scintilla::IDocument {
+	Scintilla::IDocument *pAccess;
+	Sci_Position position;		// of the next style
+	Sci_Position firstStyle;
+	std::vector<int> styles;	// from firstStyle on, -1 where none was written
+	Sci_Position firstLine;
+	std::vector<int> levels;	// same from firstLine on
+
+	// Makes room for count values from index on.
+	static int *Room(std::vector<int> &values, Sci_Position &first, Sci_Position index, Sci_Position count) {
+		if (values.empty())
+			first = index;
+		if (index < first) {
+			values.insert(values.begin(), first - index, -1);
+			first = index;
+		}
+		if (index + count > first + static_cast<Sci_Position>(values.size()))
+			values.resize(index + count - first, -1);
+		return values.data() + (index - first);
+	}
+	static int Kept(const std::vector<int> &values, Sci_Position first, Sci_Position index) {
+		if (index < first || index >= first + static_cast<Sci_Position>(values.size()))
+			return -1;
+		return values[index - first];
+	}
+	static void Truncate(std::vector<int> &values, Sci_Position first, Sci_Position index) {
+		values.resize(std::max<Sci_Position>(0, std::min<Sci_Position>(values.size(), index - first)));
+	}
+public:
+	RecordingDocument() : pAccess(nullptr), position(0), firstStyle(0), firstLine(0) {
+	}
+	RecordingDocument(const RecordingDocument &) = delete;
+	RecordingDocument &operator=(const RecordingDocument &) = delete;
+	virtual ~RecordingDocument() {
+	}
+	// Starts a call on pAccess_.
+	void Begin(Scintilla::IDocument *pAccess_) {
+		pAccess = pAccess_;
+		position = 0;
+	}
+	// Forgets the styles from position on, which are lexed again.
+	void TruncateStyles(Sci_Position at) {
+		Truncate(styles, firstStyle, at);
+	}
+	// Same for the levels from line on.
+	void TruncateLevels(Sci_Position line) {
+		Truncate(levels, firstLine, line);
+	}
+	// Keeps the document's levels of the lines from line up to end for
+	// which there are none yet, so they can be read as they are now.
+	void KeepLevels(Sci_Position line, Sci_Position end) {
+		for (; line < end; line++) {
+			if (LevelWritten(line) < 0)
+				*Room(levels, firstLine, line, 1) = pAccess->GetLevel(line);
+		}
+	}
+	// What was written, -1 for nothing.
+	int StyleWritten(Sci_Position at) const {
+		return Kept(styles, firstStyle, at);
+	}
+	int LevelWritten(Sci_Position line) const {
+		return Kept(levels, firstLine, line);
+	}
+
+	void SCI_METHOD StartStyling(Sci_Position position_) override {
+		position = position_;
+	}
+	bool SCI_METHOD SetStyleFor(Sci_Position length, char style) override {
+		if (length > 0)
+			std::fill_n(Room(styles, firstStyle, position, length), length, static_cast<unsigned char>(style));
+		position += length;
+		return true;
+	}
+	bool SCI_METHOD SetStyles(Sci_Position length, const char *styles_) override {
+		if (length > 0) {
+			int *kept = Room(styles, firstStyle, position, length);
+			for (Sci_Position i = 0; i < length; i++)
+				kept[i] = static_cast<unsigned char>(styles_[i]);
+		}
+		position += length;
+		return true;
+	}
+	char SCI_METHOD StyleAt(Sci_Position at) const override {
+		const int style = StyleWritten(at);
+		return style >= 0 ? static_cast<char>(style) : pAccess->StyleAt(at);
+	}
+	int SCI_METHOD GetLevel(Sci_Position line) const override {
+		const int level = LevelWritten(line);
+		return level >= 0 ? level : pAccess->GetLevel(line);
+	}
+	int SCI_METHOD SetLevel(Sci_Position line, int level) override {
+		*Room(levels, firstLine, line, 1) = level;
+		return level;
+	}
+	int SCI_METHOD SetLineState(Sci_Position, int state) override {
+		return state;
+	}
+	void SCI_METHOD DecorationFillRange(Sci_Position, int, Sci_Position) override {
+	}
+	void SCI_METHOD ChangeLexerState(Sci_Position, Sci_Position) override {
+	}
+
+	int SCI_METHOD Version() const override {
+		return pAccess->Version();
+	}
+	void SCI_METHOD SetErrorStatus(int status) override {
+		pAccess->SetErrorStatus(status);
+	}
+	Sci_Position SCI_METHOD Length() const override {
+		return pAccess->Length();
+	}
+	void SCI_METHOD GetCharRange(char *buffer, Sci_Position at, Sci_Position lengthRetrieve) const override {
+		pAccess->GetCharRange(buffer, at, lengthRetrieve);
+	}
+	Sci_Position SCI_METHOD LineFromPosition(Sci_Position at) const override {
+		return pAccess->LineFromPosition(at);
+	}
+	Sci_Position SCI_METHOD LineStart(Sci_Position line) const override {
+		return pAccess->LineStart(line);
+	}
+	int SCI_METHOD GetLineState(Sci_Position line) const override {
+		return pAccess->GetLineState(line);
+	}
+	void SCI_METHOD DecorationSetCurrentIndicator(int) override {
+	}
+	int SCI_METHOD CodePage() const override {
+		return pAccess->CodePage();
+	}
+	bool SCI_METHOD IsDBCSLeadByte(char ch) const override {
+		return pAccess->IsDBCSLeadByte(ch);
+	}
+	const char * SCI_METHOD BufferPointer() override {
+		return pAccess->BufferPointer();
+	}
+	int SCI_METHOD GetLineIndentation(Sci_Position line) override {
+		return pAccess->GetLineIndentation(line);
+	}
+	Sci_Position SCI_METHOD LineEnd(Sci_Position line) const override {
+		return pAccess->LineEnd(line);
+	}
+	Sci_Position SCI_METHOD GetRelativePosition(Sci_Position positionStart, Sci_Position characterOffset) const override {
+		return pAccess->GetRelativePosition(positionStart, characterOffset);
+	}
+	int SCI_METHOD GetCharacterAndWidth(Sci_Position at, Sci_Position *pWidth) const override {
+		return pAccess->GetCharacterAndWidth(at, pWidth);
+	}
+};
+
+// Verify mode: makes every call twice, once with the fast paths, writing
+// to the document, and once with a reference lexer, writing to a
+// RecordingDocument, then compares everything the reference has for the
+// range the fast paths got to with the document and times both.
+//
+// The reference keeps its own styles and levels, so it folds from the
+// styles it wrote and not from the ones it checks. The text after the
+// range it lexes is taken to be styled already, and the fast paths may
+// have left it alone, so it is only compared when it is lexed again.
+//
+// After a call, the answers the indexes give are also compared with those
+// of indexes built again from scratch from the styles and levels the
+// document holds.
+class DualRun {
+	RecordingDocument reference;
+	LexerVerify result;
+	Sci_PositionU callStart;	// of the call compared last
+	int callInitStyle;
+	bool differed;				// whether it was counted in divergences
+
+	static double Since(std::chrono::steady_clock::time_point start) {
+		const std::chrono::duration<double, std::micro> elapsed =
+			std::chrono::steady_clock::now() - start;
+		return elapsed.count();
+	}
+	// Counts the call compared last as one after which the results
+	// differed, once. Returns whether it is the first such call.
+	bool Differ() {
+		if (differed)
+			return false;
+		differed = true;
+		if (result.divergences++ > 0)
+			return false;
+		result.callStart = callStart;
+		result.callInitStyle = callInitStyle;
+		return true;
+	}
+	void DifferAt(int query, Sci_Position at) {
+		Differ();
+		if (result.query == 0) {
+			result.query = query;
+			result.queryAt = at;
+		}
+	}
+	void Compare(Scintilla::IDocument *pAccess, Sci_PositionU startPos, int initStyle,
+		Sci_Position endStyle, Sci_Position firstLine, Sci_Position endLine) {
+		result.calls++;
+		callStart = startPos;
+		callInitStyle = initStyle;
+		differed = false;
+		Sci_Position position = -1;
+		for (Sci_Position at = startPos; at < endStyle; at++) {
+			const int referenceStyle = reference.StyleWritten(at);
+			if (referenceStyle != static_cast<unsigned char>(pAccess->StyleAt(at))) {
+				position = at;
+				break;
+			}
+		}
+		Sci_Position line = -1;
+		for (Sci_Position at = firstLine; at < endLine; at++) {
+			if (reference.LevelWritten(at) != pAccess->GetLevel(at)) {
+				line = at;
+				break;
+			}
+		}
+		if ((position < 0 && line < 0) || !Differ())
+			return;
+		if (position >= 0) {
+			result.position = position;
+			result.style = static_cast<unsigned char>(pAccess->StyleAt(position));
+			result.referenceStyle = reference.StyleWritten(position);
+		}
+		if (line >= 0) {
+			result.line = line;
+			result.level = pAccess->GetLevel(line);
+			result.referenceLevel = reference.LevelWritten(line);
+		}
+	}
+public:
+	DualRun() : callStart(0), callInitStyle(-1), differed(false) {
+		Reset();
+	}
+	void Reset() {
+		result = LexerVerify{ 0, 0, -1, -1, -1, 0, 0, -1, 0, 0, 0, -1, 0.0, 0.0, 0.0, 0.0 };
+	}
+	// lex styles the document with the fast paths and returns where it got
+	// to, referenceLex(document, end) styles the recording from startPos
+	// up to end.
+	template <typename Call, typename ReferenceCall>
+	void Lex(Call lex, ReferenceCall referenceLex, Sci_PositionU startPos, int initStyle,
+		Scintilla::IDocument *pAccess) {
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		const Sci_Position reached = lex();
+		result.lexTime += Since(start);
+		reference.Begin(pAccess);
+		reference.TruncateStyles(startPos);
+		start = std::chrono::steady_clock::now();
+		referenceLex(&reference, reached);
+		result.referenceLexTime += Since(start);
+		Compare(pAccess, startPos, initStyle, reached, 0, 0);
+	}
+	// Same for fold, which may fold the range from startPos on. The levels
+	// in it are kept from before the fast paths change them, as the
+	// reference reads the ones it does not write. Like the fast paths it
+	// starts from the level the document has for the first line, which
+	// the host may have changed, such as when a line was split in two.
+	template <typename Call, typename ReferenceCall>
+	void Fold(Call fold, ReferenceCall referenceFold, Sci_PositionU startPos, Sci_Position length,
+		Scintilla::IDocument *pAccess) {
+		const Sci_Position firstLine = pAccess->LineFromPosition(startPos);
+		const Sci_Position lastLine = pAccess->LineFromPosition(startPos + length) + 1;
+		reference.Begin(pAccess);
+		reference.TruncateLevels(firstLine);
+		reference.KeepLevels(firstLine, lastLine + 1);
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		const Sci_Position reached = fold();
+		result.foldTime += Since(start);
+		start = std::chrono::steady_clock::now();
+		referenceFold(&reference, reached);
+		result.referenceFoldTime += Since(start);
+		const Sci_Position endLine = std::min(pAccess->LineFromPosition(reached) + 1, lastLine + 1);
+		Compare(pAccess, startPos, -1, startPos, firstLine, endLine);
+	}
+	// Compares LEXER_CALL_FOLD_AT for every line before the one the last
+	// Fold got to. A fold still open there may have been closed by the
+	// level of that line, which the levels before it do not say.
+	void CompareFolds(const FoldIndex &folds, Scintilla::IDocument *pAccess, Sci_Position foldedTo) {
+		const Sci_Position lastLine = pAccess->LineFromPosition(foldedTo);
+		FoldIndex rebuilt;
+		for (Sci_Position line = 0; line < lastLine; line++) {
+			const int level = pAccess->GetLevel(line);
+			rebuilt.Line(line, level & SC_FOLDLEVELNUMBERMASK, (level & SC_FOLDLEVELHEADERFLAG) != 0,
+				LEXER_FOLD_BLOCK);
+		}
+		for (Sci_Position line = 0; line < lastLine; line++) {
+			LexerFoldQuery query = { LEXER_FOLD_ANY, line, -1, {} };
+			LexerFoldQuery expected = query;
+			folds.Query(LEXER_CALL_FOLD_AT, &query);
+			rebuilt.Query(LEXER_CALL_FOLD_AT, &expected);
+			const LexerFold &a = query.fold;
+			const LexerFold &b = expected.fold;
+			if (query.index != expected.index || (query.index >= 0
+				&& (a.startLine != b.startLine || a.level != b.level || a.parent != b.parent
+					|| (a.endLine != b.endLine && (b.endLine >= 0 || a.endLine != lastLine - 1))))) {
+				DifferAt(LEXER_CALL_FOLD_AT, line);
+				return;
+			}
+		}
+		LexerFoldQuery next = { LEXER_FOLD_ANY, lastLine - 1, -1, {} };
+		if (folds.Query(LEXER_CALL_FOLD_NEXT, &next)->index >= 0)
+			DifferAt(LEXER_CALL_FOLD_NEXT, lastLine - 1);
+	}
+	// Compares LEXER_CALL_BRACE_MATCH for every bracket before where the
+	// last Lex got to, pairing the ones styled as style.
+	void CompareBraces(const BraceIndex &braces, int style, Scintilla::IDocument *pAccess,
+		Sci_Position lexedTo) {
+		const char *text = pAccess->BufferPointer();
+		BraceIndex rebuilt;
+		rebuilt.Truncate(0, pAccess->Length());
+		for (Sci_Position position = 0; position < lexedTo; position++) {
+			if (text[position] && strchr("{}[]()", text[position])
+				&& static_cast<unsigned char>(pAccess->StyleAt(position)) == style)
+				rebuilt.Add(position, text[position]);
+		}
+		rebuilt.Restore(lexedTo, lexedTo);
+		for (Sci_Position position = 0; position < lexedTo; position++) {
+			if (!text[position] || !strchr("{}[]()", text[position]))
+				continue;
+			LexerBraceQuery query = { position, 0, -1, -1 };
+			LexerBraceQuery expected = query;
+			braces.Query(LEXER_CALL_BRACE_MATCH, &query);
+			rebuilt.Query(LEXER_CALL_BRACE_MATCH, &expected);
+			if (query.open != expected.open || query.close != expected.close) {
+				DifferAt(LEXER_CALL_BRACE_MATCH, position);
+				return;
+			}
+		}
+	}
+	// Compares LEXER_CALL_RUNS for the whole document, which has to give
+	// the runs of the styles up to where the last Lex got to.
+	void CompareRuns(const RunIndex &runs, const Lexilla::SubStyles &subStyles,
+		Scintilla::IDocument *pAccess, Sci_Position lexedTo) {
+		RunIndex rebuilt;
+		rebuilt.Truncate(0, subStyles);
+		for (Sci_Position position = 0; position < lexedTo; position++)
+			rebuilt.Add(position, 1, static_cast<unsigned char>(pAccess->StyleAt(position)));
+		LexerRunQuery query = { 0, pAccess->Length(), nullptr, 0 };
+		LexerRunQuery expected = query;
+		runs.Query(&query);
+		rebuilt.Query(&expected);
+		for (int i = 0; i < query.count || i < expected.count; i++) {
+			if (i >= query.count || i >= expected.count || query.runs[i].start != expected.runs[i].start
+				|| query.runs[i].length != expected.runs[i].length
+				|| query.runs[i].style != expected.runs[i].style
+				|| query.runs[i].subStyle != expected.runs[i].subStyle) {
+				DifferAt(LEXER_CALL_RUNS, i < expected.count ? expected.runs[i].start
+					: query.runs[i].start);
+				return;
+			}
+		}
+	}
+	// Answers a LEXER_CALL_VERIFY PrivateCall.
+	LexerVerify *Fill(LexerVerify *verify) const {
+		*verify = result;
+		return verify;
+	}
+};
+
+#endif // DUALRUN_H
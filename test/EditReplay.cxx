@@ -0,0 +1,165 @@
+/*
+ * Copyright 2018-2019 Kacper Kasper <kacperkasper@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+
+// Replays typing into a large document and reports the time from each
+// keystroke to restyled and refolded text. Like Scintilla, it only asks
+// for styles up to the end of the screen, starting where the edit put the
+// end of styled text back to.
+//
+//	EditReplay LexJam.so jam [file] [name=value...]
+//
+// Without a file a generated document of about 4 MB is used. Properties,
+// such as lexer.jam.style.buffer.size, are set before the document is
+// loaded. At the end the document is styled in full and compared with a
+// fresh lexer styling the edited text at once, which fails the run if
+// restarting or invalidation lost any style.
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#include "TestCorpus.h"
+#include "TestDocument.h"
+#include "TestLexer.h"
+
+#include "common.h"
+
+namespace {
+
+// Text typed one character at a time, at places found in the document.
+struct Script {
+	const char *name;
+	const char *anchor;		// typed after it, or at line starts if null
+	const char *typed;
+	bool first;				// typed on the first line at every place
+};
+
+const Script jamScripts[] = {
+	{ "in a string", "\"str ", "more text $(TARGET_ARCH) " },
+	{ "opening a {", nullptr, "if $(x) {" },
+	{ "inserting $(", "= ", "$(HAIKU_TOP)/src " },
+	{ "starting a comment", nullptr, "# " },
+	{ "on the first line", nullptr, "# top ", true },
+};
+
+const Script yabScripts[] = {
+	{ "in a string", "\"hello ", "more text " },
+	{ "starting a /' comment", nullptr, "/' " },
+	{ "opening a function", nullptr, "function f(a)\n" },
+	{ "a number", "= ", "&hFF + " },
+	{ "on the first line", nullptr, "' top ", true },
+};
+
+const int placesPerScript = 16;
+const int screenLines = 60;
+
+double Percentile(std::vector<double> &times, int percent) {
+	if (times.empty())
+		return 0;
+	std::sort(times.begin(), times.end());
+	return times[std::min(times.size() - 1, times.size() * percent / 100)];
+}
+
+double Since(std::chrono::steady_clock::time_point start) {
+	const std::chrono::duration<double, std::micro> elapsed =
+		std::chrono::steady_clock::now() - start;
+	return elapsed.count();
+}
+
+}
+
+int main(int argc, char **argv) {
+	if (argc < 3) {
+		fprintf(stderr, "usage: %s LexJam.so|LexYAB.so jam|yab [file] [name=value...]\n", argv[0]);
+		return 2;
+	}
+	const char *name = argv[2];
+	std::string text;
+	if (argc > 3 && !strchr(argv[3], '=')) {
+		if (!ReadFile(argv[3], text)) {
+			fprintf(stderr, "cannot read %s\n", argv[3]);
+			return 2;
+		}
+	} else {
+		text = Corpus(1).Generate(name, 4 * 1024 * 1024);
+	}
+	Scintilla::ILexer5 *lexer = LoadLexer(argv[1], name);
+	ConfigureLexer(lexer, name);
+	SetProperties(lexer, argc - 3, argv + 3);
+
+	TestDocument doc(text);
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	CHECK(StyleTo(lexer, doc, doc.Length()), "loading stopped at %ld", static_cast<long>(doc.endStyled));
+	printf("%s: %ld bytes, %ld lines, loaded in %.1f ms with %ld style writes\n", name,
+		static_cast<long>(doc.Length()), static_cast<long>(doc.Lines()), Since(start) / 1000,
+		doc.styleWrites);
+	// the lexer only records latencies from here on
+	lexer->PrivateCall(LEXER_CALL_LATENCY_RESET, nullptr);
+
+	const bool jam = strcmp(name, "jam") == 0;
+	const Script *scripts = jam ? jamScripts : yabScripts;
+	const int scriptCount = jam ? sizeof(jamScripts) / sizeof(jamScripts[0])
+		: sizeof(yabScripts) / sizeof(yabScripts[0]);
+	std::vector<double> all;
+	for (int s = 0; s < scriptCount; s++) {
+		const Script &script = scripts[s];
+		std::vector<double> times;
+		long writes = 0;
+		for (int place = 0; place < placesPerScript; place++) {
+			const Sci_Position from = doc.Length() / placesPerScript * place;
+			Sci_Position position = script.first ? 0 : doc.LineStart(doc.LineFromPosition(from) + 1);
+			if (script.anchor) {
+				const size_t found = doc.text.find(script.anchor, from);
+				if (found != std::string::npos)
+					position = found + strlen(script.anchor);
+			}
+			for (const char *typed = script.typed; *typed; typed++, position++) {
+				doc.Insert(position, std::string(1, *typed));
+				const Sci_Position screenEnd = doc.LineStart(doc.LineFromPosition(position) + screenLines);
+				const long writesBefore = doc.styleWrites;
+				start = std::chrono::steady_clock::now();
+				CHECK(StyleTo(lexer, doc, screenEnd), "%s: styling stopped at %ld", script.name,
+					static_cast<long>(doc.endStyled));
+				times.push_back(Since(start));
+				writes += doc.styleWrites - writesBefore;
+			}
+		}
+		all.insert(all.end(), times.begin(), times.end());
+		const size_t keystrokes = times.size();
+		printf("  %-24s %4zu keystrokes  p50 %8.1f us  p99 %8.1f us  %.1f style writes each\n",
+			script.name, keystrokes, Percentile(times, 50), Percentile(times, 99),
+			keystrokes ? static_cast<double>(writes) / keystrokes : 0.0);
+	}
+	printf("  %-24s %4zu keystrokes  p50 %8.1f us  p99 %8.1f us\n", "all", all.size(),
+		Percentile(all, 50), Percentile(all, 99));
+	LexerLatency latency;
+	if (lexer->PrivateCall(LEXER_CALL_LATENCY, &latency)) {
+		printf("  as recorded by the lexer: Lex p50 %.1f us p99 %.1f us, Fold p50 %.1f us p99 %.1f us\n",
+			latency.lexP50, latency.lexP99, latency.foldP50, latency.foldP99);
+	}
+
+	CHECK(StyleTo(lexer, doc, doc.Length()), "final styling stopped at %ld", static_cast<long>(doc.endStyled));
+	Scintilla::ILexer5 *fresh = LoadLexer(argv[1], name);
+	ConfigureLexer(fresh, name);
+	SetProperties(fresh, argc - 3, argv + 3);
+	TestDocument once(doc.text);
+	StyleTo(fresh, once, once.Length());
+	const Sci_Position position = StyleDifference(doc, once, doc.Length());
+	CHECK(position < 0, "style at %ld is %d after the edits, %d when styled at once",
+		static_cast<long>(position), doc.StyleAt(position), once.StyleAt(position));
+	// Levels are only reported: as in Scintilla, folding starts again at the
+	// line of the edit, so a comment typed on the line after another one
+	// does not make that one a fold header, and the levels after it stay
+	// one lower.
+	Sci_Position line = 0;
+	while (line < doc.Lines() && doc.GetLevel(line) == once.GetLevel(line))
+		line++;
+	if (line < doc.Lines())
+		printf("  fold levels differ from folding at once from line %ld on\n", static_cast<long>(line));
+
+	fresh->Release();
+	lexer->Release();
+	return failures > 0 ? 1 : 0;
+}
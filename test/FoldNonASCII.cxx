@@ -0,0 +1,50 @@
+/*
+ * Copyright 2018-2019 Kacper Kasper <kacperkasper@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+
+// Fold levels of yab text with bytes >= 0x80, which Fold reads as negative
+// chars. They are neither white space nor part of an identifier, the same
+// as for Lex.
+//
+//	FoldNonASCII LexYAB.so
+
+#include "TestDocument.h"
+#include "TestLexer.h"
+
+int main(int argc, char **argv) {
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s LexYAB.so\n", argv[0]);
+		return 2;
+	}
+	Scintilla::ILexer5 *lexer = LoadLexer(argv[1], "yab");
+	lexer->PropertySet("fold", "1");
+
+	TestDocument doc(
+		"function f()\n"
+		"  \xE6\x97\xA5\xE6\x9C\xAC = 1\n"		// 日本
+		"end function\n"
+		"function\xC3\xA9()\n"					// functioné
+		"\xC3\xA9\n"							// é
+		"end function\n");
+	lexer->Lex(0, doc.Length(), 0, &doc);
+	lexer->Fold(0, doc.Length(), 0, &doc);
+
+	const int levels[] = {
+		SC_FOLDLEVELBASE | SC_FOLDLEVELHEADERFLAG,
+		SC_FOLDLEVELBASE + 1,
+		SC_FOLDLEVELBASE + 1,
+		// the word ends where the identifier Lex styles does
+		SC_FOLDLEVELBASE | SC_FOLDLEVELHEADERFLAG,
+		SC_FOLDLEVELBASE + 1,
+		SC_FOLDLEVELBASE + 1,
+		SC_FOLDLEVELBASE
+	};
+	for (int line = 0; line < static_cast<int>(sizeof(levels) / sizeof(levels[0])); line++) {
+		CHECK(doc.GetLevel(line) == levels[line], "line %d: level %#x, expected %#x",
+			line, doc.GetLevel(line), levels[line]);
+	}
+
+	lexer->Release();
+	return failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,194 @@
+/*
+ * Copyright 2018-2019 Kacper Kasper <kacperkasper@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+
+// Checks the indexes once an edit has only been restyled up to the end of
+// the screen: the fold index has to hold the folds the levels make up to
+// there and none after it, and the bracket index has to pair the brackets
+// up to there as the styles do and not know the ones after it, also when
+// two edits were made before restyling. Then random text is typed with
+// only the screen restyled each time, and once the document is styled to
+// the end the indexes have to hold what its levels and styles say.
+//
+//	IndexTail LexJam.so jam [name=value...]
+
+#include <vector>
+
+#include "TestCorpus.h"
+#include "TestDocument.h"
+#include "TestLexer.h"
+
+#include "common.h"
+
+namespace {
+
+const int screenLines = 60;
+
+// Folds of the index, in order.
+std::vector<LexerFold> Folds(Scintilla::ILexer5 *lexer) {
+	std::vector<LexerFold> folds;
+	LexerFoldQuery query = {};
+	for (query.index = 0;; query.index++) {
+		query.kind = LEXER_FOLD_ANY;
+		if (!lexer->PrivateCall(LEXER_CALL_FOLD_GET, &query) || query.index < 0)
+			break;
+		folds.push_back(query.fold);
+	}
+	return folds;
+}
+
+// Folds as the levels of the first lines of doc make them, in order.
+std::vector<LexerFold> FoldsOf(const TestDocument &doc, Sci_Position lines) {
+	std::vector<LexerFold> folds;
+	std::vector<int> open;
+	for (Sci_Position line = 0; line < lines; line++) {
+		const int level = doc.GetLevel(line) & SC_FOLDLEVELNUMBERMASK;
+		while (!open.empty() && folds[open.back()].level >= level) {
+			folds[open.back()].endLine = line - 1;
+			open.pop_back();
+		}
+		if (doc.GetLevel(line) & SC_FOLDLEVELHEADERFLAG) {
+			open.push_back(static_cast<int>(folds.size()));
+			folds.push_back({ line, -1, level, 0, open.size() > 1 ? open[open.size() - 2] : -1 });
+		}
+	}
+	return folds;
+}
+
+// Checks the folds of the index against the ones the levels of the lines
+// before the line Fold got to make. A fold still open there may have been
+// closed by the level of that line, which the levels before it do not say.
+void CheckFolds(Scintilla::ILexer5 *lexer, const TestDocument &doc, const char *what) {
+	const Sci_Position lastLine = doc.LineFromPosition(
+		static_cast<const LexerStatus *>(lexer->PrivateCall(LEXER_CALL_STATUS, nullptr))->foldedTo);
+	const std::vector<LexerFold> expected = FoldsOf(doc, lastLine);
+	const std::vector<LexerFold> folds = Folds(lexer);
+	CHECK(folds.size() == expected.size(), "%s: %zu folds, %zu in the levels before line %ld",
+		what, folds.size(), expected.size(), static_cast<long>(lastLine));
+	for (size_t i = 0; i < folds.size() && i < expected.size(); i++) {
+		const LexerFold &a = folds[i];
+		const LexerFold &b = expected[i];
+		const bool end = a.endLine == b.endLine || (b.endLine < 0 && a.endLine == lastLine - 1);
+		if (a.startLine != b.startLine || !end || a.level != b.level || a.parent != b.parent) {
+			CHECK(false, "%s: fold %zu is %ld to %ld in %d, the levels make it %ld to %ld in %d",
+				what, i, static_cast<long>(a.startLine), static_cast<long>(a.endLine), a.parent,
+				static_cast<long>(b.startLine), static_cast<long>(b.endLine), b.parent);
+			break;
+		}
+	}
+}
+
+// Checks the pair the index has for every bracket against the pairs the
+// brackets styled as style make. The index only knows the text before
+// where Lex got to, it has no pair for a bracket there or after it.
+void CheckBraces(Scintilla::ILexer5 *lexer, const TestDocument &doc, int style, const char *what) {
+	const Sci_Position known =
+		static_cast<const LexerStatus *>(lexer->PrivateCall(LEXER_CALL_STATUS, nullptr))->lexedTo;
+	const char brackets[] = "{}[]()";
+	std::vector<LexerBraceQuery> expected;
+	std::vector<size_t> open[3];
+	for (Sci_Position position = 0; position < doc.Length(); position++) {
+		const char *bracket = doc.text[position] ? strchr(brackets, doc.text[position]) : nullptr;
+		if (!bracket)
+			continue;
+		LexerBraceQuery brace = { position, doc.text[position], -1, -1 };
+		if (position < known && doc.StyleAt(position) == style) {
+			std::vector<size_t> &stack = open[(bracket - brackets) / 2];
+			if ((bracket - brackets) % 2 == 0) {
+				brace.open = position;
+				stack.push_back(expected.size());
+			} else {
+				brace.close = position;
+				if (!stack.empty()) {
+					brace.open = expected[stack.back()].position;
+					expected[stack.back()].close = position;
+					stack.pop_back();
+				}
+			}
+		}
+		expected.push_back(brace);
+	}
+	for (const LexerBraceQuery &brace : expected) {
+		LexerBraceQuery query = {};
+		query.position = brace.position;
+		lexer->PrivateCall(LEXER_CALL_BRACE_MATCH, &query);
+		if (query.open != brace.open || query.close != brace.close) {
+			CHECK(false, "%s: bracket at %ld pairs %ld with %ld, the styles %ld with %ld", what,
+				static_cast<long>(brace.position), static_cast<long>(query.open),
+				static_cast<long>(query.close), static_cast<long>(brace.open),
+				static_cast<long>(brace.close));
+			break;
+		}
+	}
+}
+
+}
+
+int main(int argc, char **argv) {
+	if (argc < 3) {
+		fprintf(stderr, "usage: %s LexJam.so|LexYAB.so jam|yab [name=value...]\n", argv[0]);
+		return 2;
+	}
+	const char *name = argv[2];
+	Scintilla::ILexer5 *lexer = LoadLexer(argv[1], name);
+	ConfigureLexer(lexer, name);
+	SetProperties(lexer, argc - 3, argv + 3);
+	const bool jam = strcmp(name, "jam") == 0;
+	const int jamOperator = 5;	// SCE_JAM_OPERATOR
+	TestDocument doc(Corpus(4).Generate(name, 256 * 1024));
+	StyleTo(lexer, doc, doc.Length());
+
+	// Empty lines are added, and lines without brackets, quotes or comments
+	// removed, which moves the text after them without changing its pairs.
+	std::mt19937 rng(5);
+	for (int edit = 0; edit < 40; edit++) {
+		Sci_Position line = rng() % (doc.Lines() - 2 * screenLines);
+		while (edit % 2 != 0 && doc.text.find_first_of("{}[]()\"#", doc.LineStart(line))
+			< static_cast<size_t>(doc.LineStart(line + 1)))
+			line++;
+		const Sci_Position position = doc.LineStart(line);
+		if (edit % 2 == 0)
+			doc.Insert(position, "\n");
+		else
+			doc.Delete(position, doc.LineStart(line + 1) - position);
+		StyleTo(lexer, doc, doc.LineStart(line + screenLines));
+		const char *what = edit % 2 == 0 ? "adding a line" : "removing a line";
+		CheckFolds(lexer, doc, what);
+		if (jam)
+			CheckBraces(lexer, doc, jamOperator, what);
+	}
+
+	// Two edits before the screen is restyled, the first one further down,
+	// so the text between them only moved by the second one. The indexes
+	// cannot tell how far the first one moved, so they must not know folds
+	// and pairs past the screen, only the ones on it.
+	for (int edit = 0; edit < 20; edit++) {
+		const Sci_Position line = rng() % (doc.Lines() / 2);
+		doc.Insert(doc.LineStart(line + screenLines + 1 + rng() % 400), "x = { ( ) }\n\n\n\n\n");
+		doc.Insert(doc.LineStart(line), "  ");
+		StyleTo(lexer, doc, doc.LineStart(line + screenLines));
+		CheckFolds(lexer, doc, "two edits");
+		if (jam)
+			CheckBraces(lexer, doc, jamOperator, "two edits");
+	}
+
+	// Anything is typed or deleted, which also changes the pairs and folds
+	// after the screen, until the rest of the document is styled again.
+	const char typed[] = "{}[]()\"#$ x;\n";
+	for (int key = 0; key < 400; key++) {
+		const Sci_Position position = rng() % doc.Length();
+		if (key % 3 == 0 && doc.text[position] != '\r' && doc.text[position] != '\n')
+			doc.Delete(position, 1);
+		else
+			doc.Insert(position, std::string(1, typed[rng() % (sizeof(typed) - 1)]));
+		StyleTo(lexer, doc, doc.LineStart(doc.LineFromPosition(position) + screenLines));
+	}
+	StyleTo(lexer, doc, doc.Length());
+	CheckFolds(lexer, doc, "typing");
+	if (jam)
+		CheckBraces(lexer, doc, jamOperator, "typing");
+
+	lexer->Release();
+	return failures > 0 ? 1 : 0;
+}
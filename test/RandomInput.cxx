@@ -0,0 +1,122 @@
+/*
+ * Copyright 2018-2019 Kacper Kasper <kacperkasper@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+
+// Styles and folds thousands of small documents of random tokens and bytes
+// in verify mode, in calls of random length and with random edits, and
+// checks that the reference lexer never styled or folded anything
+// differently. Unlike the generated corpus the text follows no grammar,
+// so it gets into the corners of the lexers: unterminated strings and
+// variables, line ends inside tokens, invalid UTF-8, and calls starting
+// and ending anywhere.
+//
+//	RandomInput LexJam.so jam [name=value...]
+
+#include <random>
+#include <vector>
+
+#include "TestDocument.h"
+#include "TestLexer.h"
+
+#include "common.h"
+
+namespace {
+
+const int documents = 2000;
+
+const char *const jamTokens[] = {
+	"local", "for", "rule", "actions", "if", "in", "on", "Objects", "SubDir", "HAIKU_TOP",
+	"$(", "$(HAIKU_TOP)", "$(x", ")", "\"", "\\\"", "#", "@", "{", "}", "[", "]", ":", ";",
+	"-", "-O2", "123", "42abc", "a", " ", "\t", "\n", "\r\n", "\r", "\xC3\xA9", "\xE2\x88\x82",
+	"\xC3", "\xFF",
+};
+
+const char *const yabTokens[] = {
+	"function", "end function", "End   Function", "type", "end type", "sub", "if", "then",
+	"endif", "print", "mid$", "myvar", "counter", "red", "label:", ".label", "rem", "//",
+	"/'", "/'*", "'/", "\\a", "@b", "#", "#{", "#}", "\"", "$1F", "&h", "&H", "&b", "&o",
+	"%101", "1.5", ".", "%", "&", "x", " ", "\t", "\n", "\r\n", "\r", "\xC3\xA9", "\xC3",
+	"\xFF", "\x01",
+};
+
+template <size_t count>
+std::string Text(std::mt19937 &rng, const char *const (&tokens)[count], size_t length) {
+	std::string text;
+	while (text.size() < length)
+		text += tokens[rng() % count];
+	return text;
+}
+
+// Styles up to position in calls of at most chunk bytes, each starting
+// where StyleTo would.
+bool StyleInChunks(Scintilla::ILexer5 *lexer, TestDocument &doc, Sci_Position position,
+	std::mt19937 &rng) {
+	while (doc.endStyled < position) {
+		const Sci_Position end = std::min<Sci_Position>(position, doc.endStyled + 1 + rng() % 200);
+		if (!StyleTo(lexer, doc, end))
+			return false;
+	}
+	return true;
+}
+
+}
+
+int main(int argc, char **argv) {
+	if (argc < 3) {
+		fprintf(stderr, "usage: %s LexJam.so|LexYAB.so jam|yab [name=value...]\n", argv[0]);
+		return 2;
+	}
+	const char *name = argv[2];
+	const bool jam = strcmp(name, "jam") == 0;
+	const std::string verify = std::string("lexer.") + name + ".verify";
+	std::mt19937 rng(11);
+	int calls = 0;
+	int differ = 0;
+	for (int document = 0; document < documents && differ < 5; document++) {
+		Scintilla::ILexer5 *lexer = LoadLexer(argv[1], name);
+		ConfigureLexer(lexer, name);
+		lexer->PropertySet(verify.c_str(), "1");
+		SetProperties(lexer, argc - 3, argv + 3);
+
+		const size_t length = 1 + rng() % 2048;
+		TestDocument doc(jam ? Text(rng, jamTokens, length) : Text(rng, yabTokens, length));
+		bool styled = StyleInChunks(lexer, doc, doc.Length(), rng);
+		for (int edit = 0; edit < 10 && doc.Length() > 0; edit++) {
+			const Sci_Position position = rng() % doc.Length();
+			if (edit % 2 == 0)
+				doc.Delete(position, std::min<Sci_Position>(1 + rng() % 8, doc.Length() - position));
+			else
+				doc.Insert(position, jam ? Text(rng, jamTokens, 1 + rng() % 8) : Text(rng, yabTokens, 1 + rng() % 8));
+			styled = styled && StyleInChunks(lexer, doc, std::min<Sci_Position>(doc.Length(),
+				position + rng() % 400), rng);
+		}
+		styled = styled && StyleInChunks(lexer, doc, doc.Length(), rng);
+		CHECK(styled, "document %d: the lexer stopped getting anywhere", document);
+
+		LexerVerify result = {};
+		CHECK(lexer->PrivateCall(LEXER_CALL_VERIFY, &result), "the lexer does not verify");
+		calls += result.calls;
+		if (result.divergences > 0) {
+			differ++;
+			CHECK(false, "document %d: %d of %d calls differ from the reference, the first one "
+				"from %ld with style %d", document, result.divergences, result.calls,
+				static_cast<long>(result.callStart), result.callInitStyle);
+			if (result.position >= 0) {
+				fprintf(stderr, "  style at %ld is %d, the reference has %d\n",
+					static_cast<long>(result.position), result.style, result.referenceStyle);
+			}
+			if (result.line >= 0) {
+				fprintf(stderr, "  level of line %ld is %x, the reference has %x\n",
+					static_cast<long>(result.line), result.level, result.referenceLevel);
+			}
+			if (result.query != 0) {
+				fprintf(stderr, "  index query %d about %ld differs from a rebuilt index\n",
+					result.query, static_cast<long>(result.queryAt));
+			}
+		}
+		lexer->Release();
+	}
+	printf("%s: %d documents, %d calls verified\n", name, documents, calls);
+	return failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,301 @@
+/*
+ * Copyright 2018-2019 Kacper Kasper <kacperkasper@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+#ifndef REFERENCEBASIC_H
+#define REFERENCEBASIC_H
+
+// Part of LexYAB.cxx, only built into it for the tests, see LEXER_VERIFY
+// in test/Makefile. It uses the states, options and tables defined there.
+
+// Lexer for the verify mode, as this one was before the fast paths: it
+// goes through StyleContext one character at a time, tries each token
+// start in turn, looks words up in WordLists and folds from the styles it
+// wrote itself. It follows the options of the lexer it checks and splits
+// lexing across calls the same way, but has no buffers, indexes or memos.
+class ReferenceBasic {
+	char comment_char;
+	int (*CheckFoldPoint)(char const *, int &);
+	WordList keywordlists[4];
+	SubStyles subStyles;
+	unsigned int generation;
+	ResumeBasic resume;
+	void Use(const TablesBasic &tables);
+public:
+	ReferenceBasic(char comment_char_, int (*CheckFoldPoint_)(char const *, int &)) :
+		comment_char(comment_char_),
+		CheckFoldPoint(CheckFoldPoint_),
+		subStyles(styleSubable, 0x80, 0x40, 0),
+		generation(0),
+		resume{-1, SCE_B_DEFAULT, true, true, SCE_B_DEFAULT} {
+	}
+	void Invalidate() {
+		resume.position = -1;
+	}
+	void Lex(const TablesBasic &tables, bool reduced, Sci_PositionU startPos, Sci_Position length,
+		int initStyle, IDocument *pAccess);
+	void Fold(const OptionsBasic &options, bool reduced, Sci_PositionU startPos, Sci_Position length,
+		IDocument *pAccess);
+};
+
+inline void ReferenceBasic::Use(const TablesBasic &tables) {
+	if (tables.generation == generation)
+		return;
+	generation = tables.generation;
+	for (int i = 0; i < 4; i++)
+		keywordlists[i].Set(tables.keywordlists[i].Words().c_str());
+	subStyles = tables.subStyles;
+	resume.position = -1;
+}
+
+inline void ReferenceBasic::Lex(const TablesBasic &tables, bool reduced, Sci_PositionU startPos, Sci_Position length,
+	int initStyle, IDocument *pAccess) {
+	Use(tables);
+	LexAccessor styler(pAccess);
+
+	bool wasfirst = true, isfirst = true; // true if first token in a line
+	styler.StartAt(startPos);
+	int styleBeforeKeyword = SCE_B_DEFAULT;
+	if (resume.position == static_cast<Sci_Position>(startPos) && resume.style == initStyle) {
+		wasfirst = resume.wasfirst;
+		isfirst = resume.isfirst;
+		styleBeforeKeyword = resume.styleBeforeKeyword;
+	}
+	resume.position = -1;
+
+	const WordClassifier &classifierIdentifiers = subStyles.Classifier(SCE_B_IDENTIFIER);
+
+	StyleContext sc(startPos, length, initStyle, styler);
+
+	// Can't use sc.More() here else we miss the last character
+	for (; ; sc.Forward()) {
+		if (!sc.More())
+			resume = { static_cast<Sci_Position>(sc.currentPos), sc.state, wasfirst, isfirst, styleBeforeKeyword };
+		if (sc.state == SCE_B_IDENTIFIER) {
+			if (!IsIdentifier(sc.ch)) {
+				// Labels
+				if (wasfirst && sc.Match(':')) {
+					sc.ChangeState(SCE_B_LABEL);
+					sc.ForwardSetState(SCE_B_DEFAULT);
+				} else {
+					char s[100];
+					int kstates[4] = {
+						SCE_B_KEYWORD,
+						SCE_B_KEYWORD2,
+						SCE_B_KEYWORD3,
+						SCE_B_KEYWORD4,
+					};
+					sc.GetCurrentLowered(s, sizeof(s));
+					if (!reduced) {
+						int subStyle = classifierIdentifiers.ValueFor(s);
+						if (subStyle >= 0) {
+							sc.ChangeState(subStyle);
+						}
+					}
+					for (int i = 0; i < 4; i++) {
+						if (keywordlists[i].InList(s)) {
+							sc.ChangeState(kstates[i]);
+						}
+					}
+					// Types, must set them as operator else they will be
+					// matched as number/constant
+					if (sc.Match('.') || sc.Match('%') || sc.Match('#')) {
+						sc.SetState(SCE_B_OPERATOR);
+					} else {
+						sc.SetState(SCE_B_DEFAULT);
+					}
+				}
+			}
+		} else if (sc.state == SCE_B_OPERATOR) {
+			if (!IsOperator(sc.ch) || sc.Match('#'))
+				sc.SetState(SCE_B_DEFAULT);
+		} else if (sc.state == SCE_B_LABEL) {
+			if (!IsIdentifier(sc.ch))
+				sc.SetState(SCE_B_DEFAULT);
+		} else if (sc.state == SCE_B_CONSTANT) {
+			if (!IsIdentifier(sc.ch))
+				sc.SetState(SCE_B_DEFAULT);
+		} else if (sc.state == SCE_B_NUMBER) {
+			if (!IsDigit(sc.ch))
+				sc.SetState(SCE_B_DEFAULT);
+		} else if (sc.state == SCE_B_HEXNUMBER) {
+			if (!IsHexDigit(sc.ch))
+				sc.SetState(SCE_B_DEFAULT);
+		} else if (sc.state == SCE_B_BINNUMBER) {
+			if (!IsBinDigit(sc.ch))
+				sc.SetState(SCE_B_DEFAULT);
+		} else if (sc.state == SCE_B_STRING) {
+			if (sc.ch == '"') {
+				sc.ForwardSetState(SCE_B_DEFAULT);
+			}
+			if (sc.atLineEnd) {
+				sc.ChangeState(SCE_B_ERROR);
+				sc.SetState(SCE_B_DEFAULT);
+			}
+		} else if (sc.state == SCE_B_COMMENT || sc.state == SCE_B_PREPROCESSOR) {
+			if (sc.atLineEnd) {
+				sc.SetState(SCE_B_DEFAULT);
+			}
+		} else if (sc.state == SCE_B_DOCLINE) {
+			if (sc.atLineEnd) {
+				sc.SetState(SCE_B_DEFAULT);
+			} else if (sc.ch == '\\' || sc.ch == '@') {
+				if (IsLetter(sc.chNext) && sc.chPrev != '\\') {
+					styleBeforeKeyword = sc.state;
+					sc.SetState(SCE_B_DOCKEYWORD);
+				};
+			}
+		} else if (sc.state == SCE_B_DOCKEYWORD) {
+			if (IsSpace(sc.ch)) {
+				sc.SetState(styleBeforeKeyword);
+			}	else if (sc.atLineEnd && styleBeforeKeyword == SCE_B_DOCLINE) {
+				sc.SetState(SCE_B_DEFAULT);
+			}
+		} else if (sc.state == SCE_B_COMMENTBLOCK) {
+			if (sc.Match("\'/")) {
+				sc.Forward();
+				sc.ForwardSetState(SCE_B_DEFAULT);
+			}
+		} else if (sc.state == SCE_B_DOCBLOCK) {
+			if (sc.Match("\'/")) {
+				sc.Forward();
+				sc.ForwardSetState(SCE_B_DEFAULT);
+			} else if (sc.ch == '\\' || sc.ch == '@') {
+				if (IsLetter(sc.chNext) && sc.chPrev != '\\') {
+					styleBeforeKeyword = sc.state;
+					sc.SetState(SCE_B_DOCKEYWORD);
+				};
+			}
+		}
+
+		if (sc.atLineStart)
+			isfirst = true;
+
+		if (sc.state == SCE_B_DEFAULT || sc.state == SCE_B_ERROR) {
+			if (isfirst && sc.Match('.') && comment_char != '\'') {
+				sc.SetState(SCE_B_LABEL);
+			} else if (sc.Match(comment_char) || sc.Match("//") || sc.Match("rem")) {
+				sc.SetState(SCE_B_COMMENT);
+			} else if (sc.Match("/\'")) {
+				if (sc.Match("/\'*") || sc.Match("/\'!")) {	// Support of gtk-doc/Doxygen doc. style
+					sc.SetState(SCE_B_DOCBLOCK);
+				} else {
+					sc.SetState(SCE_B_COMMENTBLOCK);
+				}
+				sc.Forward();	// Eat the ' so it isn't used for the end of the comment
+			} else if (sc.Match('"')) {
+				sc.SetState(SCE_B_STRING);
+			} else if (IsDigit(sc.ch)) {
+				sc.SetState(SCE_B_NUMBER);
+			// no hexadecimal, binary or constant prefixes in huge documents
+			} else if (!reduced && (sc.Match('$') || sc.Match("&h") || sc.Match("&H") || sc.Match("&o") || sc.Match("&O"))) {
+				sc.SetState(SCE_B_HEXNUMBER);
+			} else if (!reduced && (sc.Match('%') || sc.Match("&b") || sc.Match("&B"))) {
+				sc.SetState(SCE_B_BINNUMBER);
+			} else if (!reduced && sc.Match('#')) {
+				sc.SetState(SCE_B_CONSTANT);
+			} else if (IsOperator(sc.ch)) {
+				sc.SetState(SCE_B_OPERATOR);
+			} else if (IsIdentifier(sc.ch)) {
+				wasfirst = isfirst;
+				sc.SetState(SCE_B_IDENTIFIER);
+			} else if (!IsSpace(sc.ch)) {
+				sc.SetState(SCE_B_ERROR);
+			}
+		}
+
+		if (!IsSpace(sc.ch))
+			isfirst = false;
+
+		if (!sc.More())
+			break;
+	}
+	sc.Complete();
+}
+
+inline void ReferenceBasic::Fold(const OptionsBasic &options, bool reduced, Sci_PositionU startPos, Sci_Position length,
+	IDocument *pAccess) {
+	LexAccessor styler(pAccess);
+
+	Sci_Position line = styler.GetLine(startPos);
+	int level = styler.LevelAt(line);
+	int go = 0, done = 0;
+	const Sci_Position endPos = startPos + length;
+	char word[256];
+	int wordlen = 0;
+	const bool userDefinedFoldMarkers = !options.foldExplicitStart.empty() && !options.foldExplicitEnd.empty();
+	int cNext = styler[startPos];
+
+	// Scan for tokens at the start of the line (they may include
+	// whitespace, for tokens like "End Function"
+	for (Sci_Position i = startPos; i < endPos; i++) {
+		int c = cNext;
+		cNext = styler.SafeGetCharAt(i + 1);
+		bool atEOL = (c == '\r' && cNext != '\n') || (c == '\n');
+		if (options.foldSyntaxBased && !done && !go) {
+			if (wordlen) { // are we scanning a token already?
+				word[wordlen] = static_cast<char>(LowerCase(c));
+				if (!IsIdentifier(c)) { // done with token
+					word[wordlen] = '\0';
+					go = CheckFoldPoint(word, level);
+					if (!go) {
+						// Treat any whitespace as single blank, for
+						// things like "End   Function".
+						if (IsSpace(c) && IsIdentifier(word[wordlen - 1])) {
+							word[wordlen] = ' ';
+							if (wordlen < 255)
+								wordlen++;
+						}
+						else // done with this line
+							done = 1;
+					}
+				} else if (wordlen < 255) {
+					wordlen++;
+				}
+			} else { // start scanning at first non-whitespace character
+				if (!IsSpace(c)) {
+					if (IsIdentifier(c)) {
+						word[0] = static_cast<char>(LowerCase(c));
+						wordlen = 1;
+					} else // done with this line
+						done = 1;
+				}
+			}
+		}
+		if (options.foldCommentExplicit && !reduced && ((styler.StyleAt(i) == SCE_B_COMMENT) || options.foldExplicitAnywhere)) {
+			if (userDefinedFoldMarkers) {
+				if (styler.Match(i, options.foldExplicitStart.c_str())) {
+					level |= SC_FOLDLEVELHEADERFLAG;
+					go = 1;
+				} else if (styler.Match(i, options.foldExplicitEnd.c_str())) {
+					go = -1;
+				}
+			} else {
+				if (c == comment_char) {
+					if (cNext == '{') {
+						level |= SC_FOLDLEVELHEADERFLAG;
+						go = 1;
+					} else if (cNext == '}') {
+						go = -1;
+					}
+				}
+			}
+		}
+		if (atEOL) { // line end
+			if (!done && wordlen == 0 && options.foldCompact) // line was only space
+				level |= SC_FOLDLEVELWHITEFLAG;
+			if (level != styler.LevelAt(line))
+				styler.SetLevel(line, level);
+			level += go;
+			line++;
+			// reset state
+			wordlen = 0;
+			level &= ~SC_FOLDLEVELHEADERFLAG;
+			level &= ~SC_FOLDLEVELWHITEFLAG;
+			go = 0;
+			done = 0;
+		}
+	}
+}
+
+#endif // REFERENCEBASIC_H
@@ -0,0 +1,214 @@
+/*
+ * Copyright 2018-2019 Kacper Kasper <kacperkasper@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+#ifndef REFERENCEJAM_H
+#define REFERENCEJAM_H
+
+// Part of LexJam.cxx, only built into it for the tests, see LEXER_VERIFY
+// in test/Makefile. It uses the states, options and tables defined there.
+
+// Lexer for the verify mode, as this one was before the fast paths: it
+// goes through StyleContext one character at a time, looks words up in a
+// WordList and folds from the styles it wrote itself. It follows the
+// options of the lexer it checks and splits lexing across calls the same
+// way, but has no buffers, indexes or memos.
+class ReferenceJam {
+	WordList keywords;
+	SubStyles subStyles;
+	unsigned int generation;
+	ResumeJam resume;
+	void Use(const TablesJam &tables);
+public:
+	ReferenceJam() :
+		subStyles(styleSubable, 0x80, 0x40, 0),
+		generation(0),
+		resume{-1, SCE_JAM_DEFAULT, kwOther, SCE_JAM_DEFAULT} {
+	}
+	void Invalidate() {
+		resume.position = -1;
+	}
+	void Lex(const OptionsJam &options, const TablesJam &tables, bool reduced,
+		Sci_PositionU startPos, Sci_Position lengthDoc, int initStyle, IDocument *pAccess);
+	void Fold(const OptionsJam &options, bool reduced, Sci_PositionU startPos, Sci_Position length,
+		IDocument *pAccess);
+};
+
+inline void ReferenceJam::Use(const TablesJam &tables) {
+	if (tables.generation == generation)
+		return;
+	generation = tables.generation;
+	keywords.Set(tables.keywords.Words().c_str());
+	subStyles = tables.subStyles;
+	resume.position = -1;
+}
+
+inline void ReferenceJam::Lex(const OptionsJam &, const TablesJam &tables, bool reduced,
+	Sci_PositionU startPos, Sci_Position lengthDoc, int initStyle, IDocument *pAccess) {
+	Use(tables);
+	Accessor styler(pAccess, NULL);
+	StyleContext sc(startPos, lengthDoc, initStyle, styler);
+	const WordClassifier &classifierIdentifiers = subStyles.Classifier(SCE_JAM_IDENTIFIER);
+	const WordClassifier &classifierVariables = subStyles.Classifier(SCE_JAM_VARIABLE);
+
+	kwType kwLast = kwOther;
+	int varLastStyle = SCE_JAM_DEFAULT;
+	if (resume.position == static_cast<Sci_Position>(startPos) && resume.style == initStyle) {
+		kwLast = resume.kwLast;
+		varLastStyle = resume.varLastStyle;
+	}
+	for(; sc.More(); sc.Forward()) {
+		switch(sc.state) {
+			case SCE_JAM_COMMENT: {
+				if (sc.ch == '\r' || sc.ch == '\n') {
+					sc.SetState(SCE_JAM_DEFAULT);
+				}
+			} break;
+			case SCE_JAM_STRING: {
+				if (sc.Match('\"') && sc.chPrev != '\\') {
+					sc.ForwardSetState(SCE_JAM_DEFAULT);
+				} else if(sc.Match("$(")) {
+					sc.SetState(SCE_JAM_VARIABLE);
+					varLastStyle = SCE_JAM_STRING;
+				}
+			} break;
+			case SCE_JAM_NUMBER: {
+				sc.SetState(SCE_JAM_DEFAULT);
+			} break;
+			case SCE_JAM_OPERATOR: {
+				sc.SetState(SCE_JAM_DEFAULT);
+			} break;
+			case SCE_JAM_VARIABLE: {
+				if(sc.ch == ')') {
+					if (!reduced && classifierVariables.Length() > 0) {
+						char s[100];
+						sc.GetCurrent(s, sizeof(s));
+						if (strlen(s) >= 2) {
+							int subStyle = classifierVariables.ValueFor(&s[2]); // skip $(
+							if (subStyle >= 0) {
+								sc.ChangeState(subStyle);
+							}
+						}
+					}
+					sc.ForwardSetState(varLastStyle);
+					if(varLastStyle == SCE_JAM_STRING && sc.ch == '\"') {
+						sc.ForwardSetState(SCE_JAM_DEFAULT);
+					}
+				}
+			} break;
+			case SCE_JAM_IDENTIFIER: {
+				if (IsASpaceOrTab(sc.ch)
+					|| (isoperator(static_cast<char>(sc.ch)) && sc.ch != '-')
+					|| sc.ch == '$' || sc.ch == '@'
+					|| sc.ch == '\n' || sc.ch == '\r' || sc.ch == ']') {
+					char s[100];
+					sc.GetCurrent(s, sizeof(s));
+					int style = SCE_JAM_IDENTIFIER;
+					if (kwLast == kwLocal || kwLast == kwFor) {
+						style = SCE_JAM_VARIABLE;
+						int subStyle = -1;
+						if (!reduced && classifierVariables.Length() > 0)
+							subStyle = classifierVariables.ValueFor(s);
+						if (subStyle >= 0) {
+							style = subStyle;
+						}
+					} else if (keywords.InList(s)) {
+						style = SCE_JAM_KEYWORD;
+					} else if (reduced ? IsADigit(s[0]) : IsANumber(s)) {
+						style = SCE_JAM_NUMBER;
+					} else if (!reduced && classifierIdentifiers.Length() > 0) {
+						int subStyle = classifierIdentifiers.ValueFor(s);
+						if (subStyle >= 0) {
+							style = subStyle;
+						}
+					}
+					sc.ChangeState(style);
+					sc.SetState(sc.ch == '$' ? SCE_JAM_VARIABLE : SCE_JAM_DEFAULT);
+					kwLast = kwOther;
+					if(style == SCE_JAM_KEYWORD) {
+						if(strcmp(s, "local") == 0) {
+							kwLast = kwLocal;
+						} else if(strcmp(s, "for") == 0) {
+							kwLast = kwFor;
+						}
+					}
+				}
+			} break;
+		}
+		if(sc.state == SCE_JAM_DEFAULT) {
+			if (sc.Match('#')) {
+				sc.SetState(SCE_JAM_COMMENT);
+			} else if (sc.Match('\"') && sc.chPrev != '\\') {
+				sc.SetState(SCE_JAM_STRING);
+			} else if (IsASCII(sc.ch) && (isoperator(static_cast<char>(sc.ch)) || sc.ch == '@')) {
+				sc.SetState(SCE_JAM_OPERATOR);
+			} else if(isalnum(sc.ch)) {
+				sc.SetState(SCE_JAM_IDENTIFIER);
+			} else if(sc.ch == '$') {
+				varLastStyle = SCE_JAM_DEFAULT;
+				sc.SetState(SCE_JAM_VARIABLE);
+				sc.Forward();
+			}
+		}
+	}
+	resume = { static_cast<Sci_Position>(sc.currentPos), sc.state, kwLast, varLastStyle };
+	sc.Complete();
+}
+
+inline void ReferenceJam::Fold(const OptionsJam &options, bool reduced, Sci_PositionU startPos, Sci_Position length,
+	IDocument *pAccess) {
+	LexAccessor styler(pAccess);
+	const Sci_PositionU endPos = startPos + length;
+	int visibleChars = 0;
+	Sci_Position lineCurrent = styler.GetLine(startPos);
+	int levelPrev = styler.LevelAt(lineCurrent) & SC_FOLDLEVELNUMBERMASK;
+	int levelCurrent = levelPrev;
+	char chNext = styler[startPos];
+	int styleNext = styler.StyleAt(startPos);
+	for (Sci_PositionU i = startPos; i < endPos; i++) {
+		char ch = chNext;
+		chNext = styler.SafeGetCharAt(i + 1);
+		int style = styleNext;
+		styleNext = styler.StyleAt(i + 1);
+		bool atEOL = (ch == '\r' && chNext != '\n') || (ch == '\n');
+		// Comment folding
+		if (options.foldComment && !reduced && atEOL && IsCommentLine(lineCurrent, styler))
+		{
+			if (!IsCommentLine(lineCurrent - 1, styler)
+				&& IsCommentLine(lineCurrent + 1, styler))
+				levelCurrent++;
+			else if (IsCommentLine(lineCurrent - 1, styler)
+					 && !IsCommentLine(lineCurrent + 1, styler))
+				levelCurrent--;
+		}
+
+		if (style == SCE_JAM_OPERATOR) {
+			if (ch == '{') {
+				levelCurrent++;
+			} else if (ch == '}') {
+				levelCurrent--;
+			}
+		}
+
+		if (atEOL) {
+			int lev = levelPrev;
+			if (visibleChars == 0 && options.foldCompact)
+				lev |= SC_FOLDLEVELWHITEFLAG;
+			if ((levelCurrent > levelPrev) && (visibleChars > 0))
+				lev |= SC_FOLDLEVELHEADERFLAG;
+			if (lev != styler.LevelAt(lineCurrent)) {
+				styler.SetLevel(lineCurrent, lev);
+			}
+			lineCurrent++;
+			levelPrev = levelCurrent;
+			visibleChars = 0;
+		}
+		if (!isspacechar(ch))
+			visibleChars++;
+	}
+	// Fill in the real level of the next line, keeping the current flags as they will be filled in later
+	int flagsNext = styler.LevelAt(lineCurrent) & ~SC_FOLDLEVELNUMBERMASK;
+	styler.SetLevel(lineCurrent, levelPrev | flagsNext);
+}
+
+#endif // REFERENCEJAM_H
@@ -0,0 +1,106 @@
+/*
+ * Copyright 2018-2019 Kacper Kasper <kacperkasper@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+
+// Streams a document above the huge document threshold in small chunks and
+// checks that the lexer stays in one mode for the whole stream: reduced
+// when the size of the stream is given, full when it is not, as the first
+// chunk is below the threshold. Either way the styles have to be the ones
+// of the document styled at once in that mode.
+//
+//	StreamMode LexJam.so jam
+
+#include <string>
+#include <vector>
+
+#include "TestCorpus.h"
+#include "TestDocument.h"
+#include "TestLexer.h"
+
+#include "common.h"
+
+namespace {
+
+const Sci_Position chunkSize = 4096;
+
+struct Received {
+	std::vector<char> styles;
+	std::vector<int> modes;		// LexerStatus::mode after each chunk
+};
+
+void Styles(void *cookie, Sci_Position position, Sci_Position length, int style) {
+	std::vector<char> &styles = static_cast<Received *>(cookie)->styles;
+	if (styles.size() < static_cast<size_t>(position + length))
+		styles.resize(position + length);
+	std::fill(styles.begin() + position, styles.begin() + position + length, static_cast<char>(style));
+}
+
+Received Stream(Scintilla::ILexer5 *lexer, const std::string &text, Sci_Position size) {
+	Received received;
+	LexerStreamSink sink = { SC_CP_UTF8, &received, Styles, nullptr, size };
+	lexer->PrivateCall(LEXER_CALL_STREAM_BEGIN, &sink);
+	for (size_t offset = 0; offset < text.size(); offset += chunkSize) {
+		LexerStreamChunk chunk = { text.data() + offset,
+			static_cast<Sci_Position>(std::min<size_t>(chunkSize, text.size() - offset)) };
+		lexer->PrivateCall(LEXER_CALL_STREAM_FEED, &chunk);
+		const LexerStatus *status = static_cast<const LexerStatus *>(
+			lexer->PrivateCall(LEXER_CALL_STATUS, nullptr));
+		received.modes.push_back(status->mode);
+	}
+	lexer->PrivateCall(LEXER_CALL_STREAM_END, nullptr);
+	return received;
+}
+
+void Check(Scintilla::ILexer5 *lexer, Scintilla::ILexer5 *whole, const std::string &text,
+	Sci_Position size, int mode, const char *what) {
+	const Received received = Stream(lexer, text, size);
+	for (size_t i = 0; i < received.modes.size(); i++) {
+		if (received.modes[i] != mode) {
+			CHECK(false, "%s: mode %d after chunk %zu", what, received.modes[i], i);
+			break;
+		}
+	}
+	TestDocument doc(text);
+	StyleTo(whole, doc, doc.Length());
+	CHECK(received.styles.size() == text.size(), "%s: %zu styles for %zu bytes", what,
+		received.styles.size(), text.size());
+	for (size_t i = 0; i < received.styles.size() && i < text.size(); i++) {
+		if (received.styles[i] != doc.styles[i]) {
+			CHECK(false, "%s: style at %zu is %d, %d when styled at once", what, i,
+				received.styles[i], doc.styles[i]);
+			break;
+		}
+	}
+}
+
+}
+
+int main(int argc, char **argv) {
+	if (argc < 3) {
+		fprintf(stderr, "usage: %s LexJam.so|LexYAB.so jam|yab\n", argv[0]);
+		return 2;
+	}
+	const char *name = argv[2];
+	const std::string text = Corpus(6).Generate(name, 256 * 1024);
+	const std::string threshold = std::string("lexer.") + name + ".huge.threshold";
+	Scintilla::ILexer5 *lexer = LoadLexer(argv[1], name);
+	ConfigureLexer(lexer, name);
+	lexer->PropertySet(threshold.c_str(), "65536");
+
+	// styled at once, above the threshold and without one
+	Scintilla::ILexer5 *reduced = LoadLexer(argv[1], name);
+	ConfigureLexer(reduced, name);
+	reduced->PropertySet(threshold.c_str(), "65536");
+	Scintilla::ILexer5 *full = LoadLexer(argv[1], name);
+	ConfigureLexer(full, name);
+	full->PropertySet(threshold.c_str(), "0");
+
+	Check(lexer, reduced, text, text.size(), LEXER_MODE_REDUCED, "with the size");
+	Check(lexer, full, text, 0, LEXER_MODE_FULL, "without the size");
+
+	full->Release();
+	reduced->Release();
+	lexer->Release();
+	return failures > 0 ? 1 : 0;
+}
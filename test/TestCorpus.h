@@ -0,0 +1,142 @@
+/*
+ * Copyright 2018-2019 Kacper Kasper <kacperkasper@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+#ifndef TESTCORPUS_H
+#define TESTCORPUS_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <random>
+#include <string>
+
+// Text for the tests and benchmarks: files given on the command line, or
+// generated Jamfiles and yab programs. Generated text mixes the constructs
+// of real files with random bytes, UTF-8 included, and is the same for the
+// same seed.
+
+inline bool ReadFile(const char *path, std::string &text) {
+	FILE *file = fopen(path, "rb");
+	if (!file)
+		return false;
+	char buffer[64 * 1024];
+	size_t read;
+	text.clear();
+	while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0)
+		text.append(buffer, read);
+	fclose(file);
+	return true;
+}
+
+class Corpus {
+	std::mt19937 rng;
+
+	size_t Below(size_t n) {
+		return rng() % n;
+	}
+	template <size_t count>
+	const char *Pick(const char *const (&choices)[count]) {
+		return choices[Below(count)];
+	}
+	std::string Noise(const char *characters, size_t length) {
+		std::string noise;
+		const std::string from(characters);
+		for (size_t i = Below(length); i > 0; i--)
+			noise += from[Below(from.length())];
+		return noise;
+	}
+	std::string Jam() {
+		static const char *const names[] = { "Objects", "Main", "SubDir", "HAIKU_TOP", "src",
+			"foo.cpp", "bar-baz", "x86", "SubInclude", "Library", "123", "42abc", "-O2", "a.b",
+			"h\xC3\xA9llo", "\xE2\x88\x82x" };
+		static const char *const words[] = { "local", "for", "if", "else", "rule", "actions", "on",
+			"in", "return", "Objects", "$(x)", "@", "(", ")", ":", ";", "=", "!", "[", "]" };
+		const std::string indent(Below(3), '\t');
+		switch (Below(12)) {
+		case 0:
+			return indent + "# comment " + Pick(names);
+		case 1:
+			return std::string("rule ") + Pick(names) + " {";
+		case 2:
+			return std::string("actions ") + Pick(names) + "\n{\n\tcc $(1) -o $(<) \"$(>)\"\n}";
+		case 3:
+			return indent + "}";
+		case 4:
+			return indent + "local " + Pick(names) + " = " + Pick(names) + " ;";
+		case 5:
+			return indent + Pick(names) + " += \"str $(" + Pick(names) + ") \\\" q\" [ FGristFiles $(x) ] ;";
+		case 6:
+			return indent + "for f in $(" + Pick(names) + ") { Echo $(f) ; }";
+		case 7:
+			return indent + "if $(" + Pick(names) + ":D) = 1 { x ; } else { x = 12 ; }";
+		case 8:
+			return indent + "\"multi\nline string $(VAR)\n\"";
+		case 9: {
+			std::string line = indent;
+			for (size_t i = 1 + Below(8); i > 0; i--)
+				line = line + Pick(words) + " ";
+			return line;
+		}
+		case 10:
+			return indent + Noise("abc$()[]{}\"#\\ \t;:=-@1239x\xC3\xA9", 30);
+		}
+		return std::string();
+	}
+	std::string Yab() {
+		static const char *const names[] = { "myvar", "counter", "x", "y$", "print", "window",
+			"mid$", "red", "Label", "a_b", "zz", "\xC3\xBCn\xC3\xAF" };
+		static const char *const words[] = { "myvar", "x", "if", "then", "endif", "(", ")", "+",
+			"<>", ".", "%", "#", ":" };
+		const std::string indent(Below(5), ' ');
+		switch (Below(16)) {
+		case 0:
+			return indent + "rem a comment " + Pick(names);
+		case 1:
+			return indent + "// slash comment # @param x \\brief";
+		case 2:
+			return std::string("function ") + Pick(names) + "(a, b)";
+		case 3:
+			return "End Function";
+		case 4:
+			return "Type T\nend   type";
+		case 5:
+			return indent + "/' block\ncomment '/ x = 1";
+		case 6:
+			return indent + "/'* doc @brief block \\param x\n more '/";
+		case 7:
+			return indent + Pick(names) + " = &hFF + &b1010 + $1F + %101 + 12.5 + &o17 + #const";
+		case 8:
+			return indent + "print \"hello " + Pick(names) + "\" : x = x + 1";
+		case 9:
+			return indent + "print \"unterminated";
+		case 10:
+			return "label" + std::to_string(Below(1000)) + ":";
+		case 11:
+			return indent + "#{ explicit fold\n" + indent + "#} end fold";
+		case 12: {
+			std::string line = indent;
+			for (size_t i = 1 + Below(8); i > 0; i--)
+				line = line + Pick(words) + " ";
+			return line;
+		}
+		case 13:
+			return indent + Noise("ab#$%&'/\\@\"rem01hHb.: \t()\xC3\xA9*!", 30);
+		}
+		return std::string();
+	}
+public:
+	explicit Corpus(uint32_t seed) : rng(seed) {
+	}
+	// At least size bytes of text for the lexer called name.
+	std::string Generate(const char *name, size_t size) {
+		const bool jam = std::string(name) == "jam";
+		const char *lineEnd = Below(5) == 0 ? "\r\n" : "\n";
+		std::string text;
+		while (text.size() < size)
+			text += (jam ? Jam() : Yab()) + lineEnd;
+		return text;
+	}
+};
+
+#endif // TESTCORPUS_H
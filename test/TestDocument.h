@@ -0,0 +1,212 @@
+/*
+ * Copyright 2018-2019 Kacper Kasper <kacperkasper@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+#ifndef TESTDOCUMENT_H
+#define TESTDOCUMENT_H
+
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <ILexer.h>
+#include <Scintilla.h>
+
+// In-memory document for the tests, behaving like Scintilla's own: styles
+// and fold levels move with the text on edits, and the end of styled text
+// goes back to where an edit was made.
+class TestDocument : public Scintilla::IDocument {
+	std::vector<Sci_Position> lineStarts;
+
+	void Index() {
+		lineStarts.assign(1, 0);
+		for (size_t i = 0; i < text.size(); i++) {
+			if (text[i] == '\r' && i + 1 < text.size() && text[i + 1] == '\n')
+				i++;
+			if (text[i] == '\r' || text[i] == '\n')
+				lineStarts.push_back(i + 1);
+		}
+	}
+public:
+	std::string text;
+	std::vector<char> styles;
+	std::vector<int> levels;
+	std::vector<int> lineStates;
+	Sci_Position endStyled;
+	long styleWrites;		// SetStyleFor and SetStyles calls
+
+	explicit TestDocument(const std::string &text_ = std::string()) {
+		Set(text_);
+	}
+	void Set(const std::string &text_) {
+		text = text_;
+		Index();
+		styles.assign(text.size(), 0);
+		levels.assign(Lines() + 1, SC_FOLDLEVELBASE);
+		lineStates.assign(Lines() + 1, 0);
+		endStyled = 0;
+		styleWrites = 0;
+	}
+	Sci_Position Lines() const {
+		return lineStarts.size();
+	}
+	void Insert(Sci_Position position, const std::string &inserted) {
+		const Sci_Position line = LineFromPosition(position);
+		const Sci_Position lines = Lines();
+		text.insert(position, inserted);
+		styles.insert(styles.begin() + position, inserted.size(), 0);
+		Index();
+		levels.insert(levels.begin() + line + 1, Lines() - lines, SC_FOLDLEVELBASE);
+		lineStates.insert(lineStates.begin() + line + 1, Lines() - lines, 0);
+		endStyled = std::min(endStyled, position);
+	}
+	void Delete(Sci_Position position, Sci_Position length) {
+		const Sci_Position line = LineFromPosition(position);
+		const Sci_Position lines = Lines();
+		text.erase(position, length);
+		styles.erase(styles.begin() + position, styles.begin() + position + length);
+		Index();
+		levels.erase(levels.begin() + line + 1, levels.begin() + line + 1 + (lines - Lines()));
+		lineStates.erase(lineStates.begin() + line + 1, lineStates.begin() + line + 1 + (lines - Lines()));
+		endStyled = std::min(endStyled, position);
+	}
+
+	int SCI_METHOD Version() const override {
+		return Scintilla::dvRelease4;
+	}
+	void SCI_METHOD SetErrorStatus(int) override {
+	}
+	Sci_Position SCI_METHOD Length() const override {
+		return text.size();
+	}
+	void SCI_METHOD GetCharRange(char *buffer, Sci_Position position, Sci_Position lengthRetrieve) const override {
+		memcpy(buffer, text.data() + position, lengthRetrieve);
+	}
+	char SCI_METHOD StyleAt(Sci_Position position) const override {
+		if (position < 0 || position >= Length())
+			return 0;
+		return styles[position];
+	}
+	Sci_Position SCI_METHOD LineFromPosition(Sci_Position position) const override {
+		return std::upper_bound(lineStarts.begin(), lineStarts.end(), position) - lineStarts.begin() - 1;
+	}
+	Sci_Position SCI_METHOD LineStart(Sci_Position line) const override {
+		if (line < 0)
+			return 0;
+		if (line >= Lines())
+			return Length();
+		return lineStarts[line];
+	}
+	int SCI_METHOD GetLevel(Sci_Position line) const override {
+		if (line < 0 || line >= static_cast<Sci_Position>(levels.size()))
+			return SC_FOLDLEVELBASE;
+		return levels[line];
+	}
+	int SCI_METHOD SetLevel(Sci_Position line, int level) override {
+		if (line < 0 || line >= static_cast<Sci_Position>(levels.size()))
+			return SC_FOLDLEVELBASE;
+		std::swap(levels[line], level);
+		return level;
+	}
+	int SCI_METHOD GetLineState(Sci_Position line) const override {
+		if (line < 0 || line >= static_cast<Sci_Position>(lineStates.size()))
+			return 0;
+		return lineStates[line];
+	}
+	int SCI_METHOD SetLineState(Sci_Position line, int state) override {
+		if (line < 0 || line >= static_cast<Sci_Position>(lineStates.size()))
+			return 0;
+		std::swap(lineStates[line], state);
+		return state;
+	}
+	void SCI_METHOD StartStyling(Sci_Position position) override {
+		endStyled = position;
+	}
+	bool SCI_METHOD SetStyleFor(Sci_Position length, char style) override {
+		styleWrites++;
+		for (; length > 0 && endStyled < Length(); length--)
+			styles[endStyled++] = style;
+		return true;
+	}
+	bool SCI_METHOD SetStyles(Sci_Position length, const char *styles_) override {
+		styleWrites++;
+		for (Sci_Position i = 0; i < length && endStyled < Length(); i++)
+			styles[endStyled++] = styles_[i];
+		return true;
+	}
+	void SCI_METHOD DecorationSetCurrentIndicator(int) override {
+	}
+	void SCI_METHOD DecorationFillRange(Sci_Position, int, Sci_Position) override {
+	}
+	void SCI_METHOD ChangeLexerState(Sci_Position, Sci_Position) override {
+	}
+	int SCI_METHOD CodePage() const override {
+		return SC_CP_UTF8;
+	}
+	bool SCI_METHOD IsDBCSLeadByte(char) const override {
+		return false;
+	}
+	const char * SCI_METHOD BufferPointer() override {
+		return text.c_str();
+	}
+	int SCI_METHOD GetLineIndentation(Sci_Position) override {
+		return 0;
+	}
+	Sci_Position SCI_METHOD LineEnd(Sci_Position line) const override {
+		Sci_Position end = LineStart(line + 1);
+		if (line + 1 < Lines()) {
+			if (end > 0 && text[end - 1] == '\n')
+				end--;
+			if (end > 0 && text[end - 1] == '\r')
+				end--;
+		}
+		return end;
+	}
+	Sci_Position SCI_METHOD GetRelativePosition(Sci_Position positionStart, Sci_Position characterOffset) const override {
+		return positionStart + characterOffset;
+	}
+	// Decodes UTF-8, invalid bytes come back one by one as in Scintilla.
+	int SCI_METHOD GetCharacterAndWidth(Sci_Position position, Sci_Position *pWidth) const override {
+		Sci_Position width = 1;
+		int character = 0;
+		if (position >= 0 && position < Length()) {
+			const unsigned char *bytes = reinterpret_cast<const unsigned char *>(text.data()) + position;
+			character = bytes[0];
+			int trail = 0;
+			if (character >= 0xC2 && character < 0xE0)
+				trail = 1;
+			else if (character >= 0xE0 && character < 0xF0)
+				trail = 2;
+			else if (character >= 0xF0 && character < 0xF5)
+				trail = 3;
+			int decoded = character & (0x3F >> trail);
+			bool valid = trail > 0 && position + trail < Length();
+			for (int i = 1; valid && i <= trail; i++) {
+				valid = (bytes[i] & 0xC0) == 0x80;
+				decoded = (decoded << 6) | (bytes[i] & 0x3F);
+			}
+			if (valid) {
+				character = decoded;
+				width = trail + 1;
+			} else if (character >= 0x80) {
+				character = 0xDC80 + character;
+			}
+		}
+		if (pWidth)
+			*pWidth = width;
+		return character;
+	}
+};
+
+// First position up to end where the styles of a and b differ, -1 if none.
+inline Sci_Position StyleDifference(const TestDocument &a, const TestDocument &b, Sci_Position end) {
+	for (Sci_Position position = 0; position < end; position++) {
+		if (a.StyleAt(position) != b.StyleAt(position))
+			return position;
+	}
+	return -1;
+}
+
+#endif // TESTDOCUMENT_H
@@ -0,0 +1,108 @@
+/*
+ * Copyright 2018-2019 Kacper Kasper <kacperkasper@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+#ifndef TESTLEXER_H
+#define TESTLEXER_H
+
+#include <dlfcn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+
+#include <ILexer.h>
+
+#include "TestDocument.h"
+
+// Loads a lexer the way applications do, through CreateLexer of the shared
+// object built by the Makefile, and exits if that fails.
+inline Scintilla::ILexer5 *LoadLexer(const char *library, const char *name) {
+	typedef Scintilla::ILexer5 *(*CreateLexerFn)(const char *);
+	void *handle = dlopen(library, RTLD_NOW | RTLD_LOCAL);
+	if (!handle) {
+		fprintf(stderr, "%s\n", dlerror());
+		exit(2);
+	}
+	CreateLexerFn create = reinterpret_cast<CreateLexerFn>(dlsym(handle, "CreateLexer"));
+	Scintilla::ILexer5 *lexer = create ? create(name) : nullptr;
+	if (!lexer) {
+		fprintf(stderr, "%s: no lexer %s\n", library, name);
+		exit(2);
+	}
+	return lexer;
+}
+
+// Word lists, substyles and folding as an editor would set them up.
+inline void ConfigureLexer(Scintilla::ILexer5 *lexer, const char *name) {
+	lexer->PropertySet("fold", "1");
+	if (strcmp(name, "jam") == 0) {
+		lexer->WordListSet(0, "rule actions local on for in if else while switch case return "
+			"include break continue jumptoend bind together updated ignore quietly piecemeal existing");
+		const int identifiers = lexer->AllocateSubStyles(6, 2);
+		if (identifiers >= 0) {
+			lexer->SetIdentifiers(identifiers, "Objects Main SubDir");
+			lexer->SetIdentifiers(identifiers + 1, "SubInclude Library");
+		}
+		const int variables = lexer->AllocateSubStyles(7, 1);
+		if (variables >= 0)
+			lexer->SetIdentifiers(variables, "HAIKU_TOP TARGET_ARCH");
+		lexer->PropertySet("fold.comment", "1");
+	} else {
+		lexer->WordListSet(0, "if then else endif fi for to next while wend repeat until sub end "
+			"export local return print input open close function type");
+		lexer->WordListSet(1, "window button view draw text alert");
+		lexer->WordListSet(2, "mid$ left$ right$ len val str$ chr$ asc");
+		lexer->WordListSet(3, "red green blue");
+		const int identifiers = lexer->AllocateSubStyles(7, 1);
+		if (identifiers >= 0)
+			lexer->SetIdentifiers(identifiers, "myvar counter");
+		lexer->PropertySet("fold.basic.comment.explicit", "1");
+	}
+}
+
+// Sets the properties given as name=value arguments, returns how many of
+// the arguments were properties.
+inline int SetProperties(Scintilla::ILexer5 *lexer, int argc, char **argv) {
+	int count = 0;
+	for (int i = 0; i < argc; i++) {
+		const char *value = strchr(argv[i], '=');
+		if (!value)
+			continue;
+		lexer->PropertySet(std::string(argv[i], value - argv[i]).c_str(), value + 1);
+		count++;
+	}
+	return count;
+}
+
+// Styles and folds up to position the way Scintilla does: from the start of
+// the line where styling ended, with the style before it, until the lexer
+// got there. Returns false if it stopped getting anywhere.
+inline bool StyleTo(Scintilla::ILexer5 *lexer, TestDocument &doc, Sci_Position position) {
+	while (doc.endStyled < position) {
+		const Sci_Position styled = doc.endStyled;
+		const Sci_Position start = doc.LineStart(doc.LineFromPosition(styled));
+		const int initStyle = start > 0 ? static_cast<unsigned char>(doc.StyleAt(start - 1)) : 0;
+		lexer->Lex(start, position - start, initStyle, &doc);
+		lexer->Fold(start, position - start, initStyle, &doc);
+		if (doc.endStyled <= styled)
+			return false;
+	}
+	return true;
+}
+
+// Counts failed checks, and reports them with where they were made.
+static int failures = 0;
+
+#define CHECK(condition, ...) \
+	do { \
+		if (!(condition)) { \
+			failures++; \
+			fprintf(stderr, "%s:%d: ", __FILE__, __LINE__); \
+			fprintf(stderr, __VA_ARGS__); \
+			fprintf(stderr, "\n"); \
+		} \
+	} while (0)
+
+#endif // TESTLEXER_H
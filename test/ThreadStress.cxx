@@ -0,0 +1,142 @@
+/*
+ * Copyright 2018-2019 Kacper Kasper <kacperkasper@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+
+// Lexes and folds hundreds of documents on a pool of threads, one lexer
+// instance per document, and checks that every document gets the styles
+// and fold levels it gets when they are all done on one thread. Reports
+// the documents done per second for each number of threads, which should
+// grow close to linearly up to the number of cores.
+//
+// Then one thread keeps lexing a document while another keeps changing the
+// keywords of the same lexer, and every Lex has to give the styles of one
+// of the two keyword lists, never a mix of them.
+//
+//	ThreadStress LexJam.so jam [name=value...]
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "TestCorpus.h"
+#include "TestDocument.h"
+#include "TestLexer.h"
+
+namespace {
+
+const int documents = 256;
+const size_t documentSize = 16 * 1024;
+const int keywordLexes = 200;
+
+struct Styled {
+	std::vector<char> styles;
+	std::vector<int> levels;
+};
+
+Styled Style(Scintilla::ILexer5 *lexer, const std::string &text) {
+	TestDocument doc(text);
+	StyleTo(lexer, doc, doc.Length());
+	return { doc.styles, doc.levels };
+}
+
+Scintilla::ILexer5 *NewLexer(const char *library, const char *name, int argc, char **argv) {
+	Scintilla::ILexer5 *lexer = LoadLexer(library, name);
+	ConfigureLexer(lexer, name);
+	SetProperties(lexer, argc, argv);
+	return lexer;
+}
+
+// Styles every text on threads threads, returns the time it took.
+double StyleAll(const std::vector<std::string> &texts, std::vector<Styled> &styled, int threads,
+	const char *library, const char *name, int argc, char **argv) {
+	std::atomic<size_t> next(0);
+	const auto start = std::chrono::steady_clock::now();
+	std::vector<std::thread> pool;
+	for (int t = 0; t < threads; t++) {
+		pool.emplace_back([&]() {
+			for (size_t i; (i = next.fetch_add(1)) < texts.size();) {
+				Scintilla::ILexer5 *lexer = NewLexer(library, name, argc, argv);
+				styled[i] = Style(lexer, texts[i]);
+				lexer->Release();
+			}
+		});
+	}
+	for (std::thread &thread : pool)
+		thread.join();
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void CheckKeywordChanges(const char *library, const char *name, int argc, char **argv) {
+	const bool jam = strcmp(name, "jam") == 0;
+	const char *lists[] = {
+		jam ? "rule actions local on for in if else" : "if then else endif for to next sub end",
+		jam ? "rule actions" : "if then else endif",
+	};
+	const std::string text = Corpus(9).Generate(name, documentSize);
+	Scintilla::ILexer5 *lexer = NewLexer(library, name, argc, argv);
+	std::vector<char> expected[2];
+	for (int list = 0; list < 2; list++) {
+		lexer->WordListSet(0, lists[list]);
+		expected[list] = Style(lexer, text).styles;
+	}
+	CHECK(expected[0] != expected[1], "the keyword lists give the same styles");
+
+	std::atomic<int> lexed(0);
+	int mixed = 0;
+	std::thread lexing([&]() {
+		for (; lexed.load() < keywordLexes; lexed++) {
+			const std::vector<char> styles = Style(lexer, text).styles;
+			if (styles != expected[0] && styles != expected[1])
+				mixed++;
+		}
+	});
+	long changes = 0;
+	for (; lexed.load() < keywordLexes; changes++)
+		lexer->WordListSet(0, lists[changes % 2]);
+	lexing.join();
+	CHECK(mixed == 0, "%d of %d Lex calls mixed the keyword lists", mixed, keywordLexes);
+	printf("  keywords changed %ld times during %d Lex calls\n", changes, keywordLexes);
+	lexer->Release();
+}
+
+}
+
+int main(int argc, char **argv) {
+	if (argc < 3) {
+		fprintf(stderr, "usage: %s LexJam.so|LexYAB.so jam|yab [name=value...]\n", argv[0]);
+		return 2;
+	}
+	const char *library = argv[1];
+	const char *name = argv[2];
+	std::vector<std::string> texts;
+	for (int i = 0; i < documents; i++)
+		texts.push_back(Corpus(100 + i).Generate(name, documentSize));
+
+	std::vector<Styled> expected(texts.size());
+	const double once = StyleAll(texts, expected, 1, library, name, argc - 3, argv + 3);
+	printf("%s: %d documents of %zu bytes, %.0f documents/s on 1 thread\n", name, documents,
+		documentSize, documents / once);
+	const int cores = std::max(2u, std::thread::hardware_concurrency());
+	std::vector<int> counts;
+	for (int threads = 2; threads < cores; threads *= 2)
+		counts.push_back(threads);
+	counts.push_back(cores);
+	for (int threads : counts) {
+		std::vector<Styled> styled(texts.size());
+		const double time = StyleAll(texts, styled, threads, library, name, argc - 3, argv + 3);
+		int differ = 0;
+		for (size_t i = 0; i < texts.size(); i++) {
+			if (styled[i].styles != expected[i].styles || styled[i].levels != expected[i].levels)
+				differ++;
+		}
+		CHECK(differ == 0, "%d threads: %d documents differ from styling on 1 thread", threads, differ);
+		printf("  %2d threads: %.0f documents/s, %.1f times 1 thread\n", threads, documents / time,
+			once / time);
+	}
+
+	CheckKeywordChanges(library, name, argc - 3, argv + 3);
+	return failures > 0 ? 1 : 0;
+}
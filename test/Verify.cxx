@@ -0,0 +1,102 @@
+/*
+ * Copyright 2018-2019 Kacper Kasper <kacperkasper@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+
+// Styles and folds a generated document in verify mode, then types and
+// deletes text all over it restyling as an editor would, and checks that
+// the reference lexer never styled or folded anything differently. Reports
+// the time both took.
+//
+//	Verify LexJam.so jam [name=value...]
+
+#include <vector>
+
+#include "TestCorpus.h"
+#include "TestDocument.h"
+#include "TestLexer.h"
+
+#include "common.h"
+
+namespace {
+
+const int screenLines = 60;
+
+// Checks what the verify mode found, which what says happened.
+void CheckVerify(Scintilla::ILexer5 *lexer, const char *what) {
+	LexerVerify verify = {};
+	if (!lexer->PrivateCall(LEXER_CALL_VERIFY, &verify)) {
+		CHECK(false, "%s: the lexer does not verify", what);
+		return;
+	}
+	CHECK(verify.calls > 0, "%s: no call was verified", what);
+	if (verify.divergences > 0) {
+		CHECK(false, "%s: %d of %d calls differ from the reference, the first one from %ld with style %d",
+			what, verify.divergences, verify.calls, static_cast<long>(verify.callStart),
+			verify.callInitStyle);
+		if (verify.position >= 0) {
+			fprintf(stderr, "  style at %ld is %d, the reference has %d\n",
+				static_cast<long>(verify.position), verify.style, verify.referenceStyle);
+		}
+		if (verify.line >= 0) {
+			fprintf(stderr, "  level of line %ld is %x, the reference has %x\n",
+				static_cast<long>(verify.line), verify.level, verify.referenceLevel);
+		}
+		if (verify.query != 0) {
+			fprintf(stderr, "  index query %d about %ld differs from a rebuilt index\n",
+				verify.query, static_cast<long>(verify.queryAt));
+		}
+	}
+	printf("  %s: %d calls, lex %.0f us (reference %.0f us), fold %.0f us (reference %.0f us)\n",
+		what, verify.calls, verify.lexTime, verify.referenceLexTime, verify.foldTime,
+		verify.referenceFoldTime);
+	lexer->PrivateCall(LEXER_CALL_VERIFY_RESET, nullptr);
+}
+
+}
+
+int main(int argc, char **argv) {
+	if (argc < 3) {
+		fprintf(stderr, "usage: %s LexJam.so|LexYAB.so jam|yab [name=value...]\n", argv[0]);
+		return 2;
+	}
+	const char *name = argv[2];
+	Scintilla::ILexer5 *lexer = LoadLexer(argv[1], name);
+	ConfigureLexer(lexer, name);
+	lexer->PropertySet((std::string("lexer.") + name + ".verify").c_str(), "1");
+	SetProperties(lexer, argc - 3, argv + 3);
+	printf("%s:\n", name);
+
+	TestDocument doc(Corpus(6).Generate(name, 256 * 1024));
+	CHECK(StyleTo(lexer, doc, doc.Length()), "the lexer stopped getting anywhere");
+	CheckVerify(lexer, "styling");
+
+	// Lines of other text, keys and deletions anywhere, each followed by
+	// restyling the screen, and now and then the rest of the document.
+	Corpus pieces(7);
+	std::mt19937 rng(8);
+	const char typed[] = "{}[]()\"#$'/ x;:\n";
+	for (int edit = 0; edit < 600; edit++) {
+		const Sci_Position position = rng() % doc.Length();
+		switch (edit % 4) {
+		case 0:
+			doc.Insert(doc.LineStart(doc.LineFromPosition(position)), pieces.Generate(name, 1));
+			break;
+		case 1:
+			doc.Delete(position, std::min<Sci_Position>(1 + rng() % 40, doc.Length() - position));
+			break;
+		default:
+			doc.Insert(position, std::string(1, typed[rng() % (sizeof(typed) - 1)]));
+			break;
+		}
+		CHECK(StyleTo(lexer, doc, doc.LineStart(doc.LineFromPosition(position) + screenLines)),
+			"the lexer stopped getting anywhere");
+		if (edit % 50 == 49)
+			CHECK(StyleTo(lexer, doc, doc.Length()), "the lexer stopped getting anywhere");
+	}
+	CHECK(StyleTo(lexer, doc, doc.Length()), "the lexer stopped getting anywhere");
+	CheckVerify(lexer, "editing");
+
+	lexer->Release();
+	return failures > 0 ? 1 : 0;
+}